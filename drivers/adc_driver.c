@@ -5,23 +5,144 @@
 #include <linux/delay.h>
 #include <linux/kernel.h>
 #include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/jiffies.h>
+#include <linux/moduleparam.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include "ramp_status.h"
+#include "adc_sample.h"
+#include "ramp_module.h"
 
 #define I2C_BUS_AVAILABLE   (1)              // I2C Bus available in our Raspberry Pi
 #define SLAVE_DEVICE_NAME   ("ETX_ADC")              // Device and Driver Name
 #define ADC_SLAVE_ADDR  (0x48)              // Slave Address
 
-static struct i2c_adapter *etx_i2c_adapter     = NULL;  // I2C Adapter Structure
+static struct i2c_adapter *etx_i2c_adapter     = NULL;  // I2C Adapter Structure, referenced until module exit
 static struct i2c_client  *etx_i2c_client_adc = NULL;  // I2C Cient Structure 
 const char INIT_MSG = 0x8c; // Message that initiates conversion for ADC 12 Click component
 const char EXIT_MSG = 0x80; // Message that shuts down ADC 
+const char IDLE_MSG = 0x80; // Conversion with power-down between conversions (PD1-PD0 = 00)
 int adc_driver_major; // Device major number
+static struct class *adc_class; // Device class, shared class when built into ramp.ko
+#define ADC_CLASS "AdcClass"
 char data[2]; // Buffer holding read data from the ADC (sensor data)
 
+/*
+** Error handling budget, every read returns a valid sample or a definite error within worst_case_us:
+**   attempts * (2 transfers * timeout_ms + retry delay) + bus recovery
+** The adapter is shared with other clients, its own timeout and retries only change for the duration of
+** a transfer of this driver, see adc_transfer.
+*/
+#define ADC_RECOVERY_THRESHOLD (3)     // Consecutive failed reads before bus recovery is attempted
+#define ADC_RECOVERY_US        (1000)  // Upper bound of 9 SCL pulses + STOP at 100kHz, with margin
+
+static unsigned int retries = 2;       // Extra attempts after a failed transfer
+module_param(retries, uint, 0444);
+MODULE_PARM_DESC(retries, "Extra I2C attempts per read after a failure");
+
+static unsigned int timeout_ms = 5;    // Timeout per transfer of this driver
+module_param(timeout_ms, uint, 0444);
+MODULE_PARM_DESC(timeout_ms, "I2C transfer timeout in ms");
+
+static unsigned int retry_delay_us = 200; // Pause between attempts, lets the converter finish
+module_param(retry_delay_us, uint, 0444);
+MODULE_PARM_DESC(retry_delay_us, "Delay between I2C attempts in us");
+
+static unsigned int worst_case_us;     // Computed at init, reported through sysfs
+module_param(worst_case_us, uint, 0444);
+MODULE_PARM_DESC(worst_case_us, "Worst case time for a read to return a sample or an error");
+
+/* Error counters, reported through sysfs */
+static unsigned int read_errors;
+module_param(read_errors, uint, 0444);
+static unsigned int read_retries;
+module_param(read_retries, uint, 0444);
+static unsigned int bus_recoveries;
+module_param(bus_recoveries, uint, 0444);
+
+static DEFINE_MUTEX(adc_lock);         // Serializes bus transactions and recovery
+static ktime_t last_good_time;         // Time of the sample held in data, 0 if none
+static unsigned int consecutive_errors;
+
+/*
+** Sampling rate schedule, selected by user-space writing "ACTIVE" or "IDLE".
+** Reads are paced by the driver: a read blocks until one period after the previous conversion.
+** In IDLE mode conversions are started with IDLE_MSG so the converter and reference are powered
+** down between the rare samples. Switching to ACTIVE wakes a reader waiting for an idle slot.
+*/
+#define ADC_RATE_ACTIVE (0)
+#define ADC_RATE_IDLE   (1)
+#define ADC_SHORT_WAIT_US (20000)      // Waits shorter than this use usleep_range, longer ones a waitqueue
+
+static unsigned int active_period_us = 2000;   // 500 Hz while boom moves or vehicle is near
+module_param(active_period_us, uint, 0644);
+MODULE_PARM_DESC(active_period_us, "Sampling period in ACTIVE mode in us");
+
+static unsigned int idle_period_us = 100000;   // 10 Hz while lane is idle and boom is down
+module_param(idle_period_us, uint, 0644);
+MODULE_PARM_DESC(idle_period_us, "Sampling period in IDLE mode in us");
+
+static unsigned int conversions;       // Number of started conversions, reported through sysfs
+module_param(conversions, uint, 0444);
+
+static int rate_mode = ADC_RATE_ACTIVE;
+static unsigned int rate_generation;   // Incremented on every mode change
+static ktime_t last_conversion;        // Start of the previous conversion
+static DECLARE_WAIT_QUEUE_HEAD(rate_wq);
+
+/*
+** Sample fan-out: one conversion per sampling slot is shared by every open file.
+** The result of the latest conversion is published under adc_lock with a sequence number,
+** a reader that has not seen it yet and finds it still within the current period gets it
+** without touching the bus, so N readers cost one conversion per period instead of N.
+*/
+static u32 sample_seq;                 // Sequence number of the published conversion
+static int sample_err;                 // Result of the published conversion, 0 or error code
+static u8 sample_flags;
+static u8 sample_attempts;
+
+/* Per-open state */
+struct adc_reader {
+    u32 seq;                           // Last published conversion delivered to this file
+};
+
 
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_AUTHOR("PURV Grupa");
 MODULE_DESCRIPTION("ADC Driver");
 
+/*
+** Runs one message of this driver with the transfer bounded to timeout_ms and no adapter retries.
+** Both are set while the bus segment is locked and restored before it is released, so other
+** clients of the adapter never see them. Returns the number of bytes transferred or an error.
+*/
+static int adc_transfer(char *buf, u16 len, u16 flags)
+{
+    struct i2c_adapter *adap = etx_i2c_client_adc->adapter;
+    struct i2c_msg msg = {
+        .addr = etx_i2c_client_adc->addr,
+        .flags = (etx_i2c_client_adc->flags & I2C_M_TEN) | flags,
+        .len = len,
+        .buf = buf,
+    };
+    int adap_timeout, adap_retries;
+    int ret;
+
+    i2c_lock_bus(adap, I2C_LOCK_SEGMENT);
+    adap_timeout = adap->timeout;
+    adap_retries = adap->retries;
+    adap->timeout = msecs_to_jiffies(timeout_ms);
+    adap->retries = 0;
+    ret = __i2c_transfer(adap, &msg, 1);
+    adap->timeout = adap_timeout;
+    adap->retries = adap_retries;
+    i2c_unlock_bus(adap, I2C_LOCK_SEGMENT);
+
+    return ret == 1 ? len : ret;
+}
+
 /*
 ** This function writes the data into the I2C client
 **
@@ -37,9 +158,12 @@ static int I2C_Write(void)
     ** ACK/NACK and Stop condtions will be handled internally.
     */
      
-    int ret = i2c_master_send(etx_i2c_client_adc, &INIT_MSG, 1);
+    char cmd = (rate_mode == ADC_RATE_IDLE) ? IDLE_MSG : INIT_MSG;
+    int ret = adc_transfer(&cmd, 1, 0);
 
     /* In our case, we just need to write INIT_MSG before every read operation, reading data from sensor is only necessary thing */
+    /* In IDLE mode IDLE_MSG is used instead, it powers the converter down after the conversion */
+    conversions++;
     return ret;
 }
 
@@ -57,11 +181,85 @@ static int I2C_Read(void)
     ** Sending Start condition, Slave address with R/W bit, 
     ** ACK/NACK and Stop condtions will be handled internally.
     */ 
-    int ret = i2c_master_recv(etx_i2c_client_adc, data, 2);
+    char rx[2];
+    int ret = adc_transfer(rx, 2, I2C_M_RD);
 
     /* Reading sensor data into the buffer, 2B of data, 4 MSBs are not used, referring to component datasheet */
+    /* Buffer is only updated on a complete transfer, so a failed read never leaves half a sample behind */
+    if (ret == 2)
+    {
+        data[0] = rx[0];
+        data[1] = rx[1];
+        return 0;
+    }
     
-    return ret;
+    return ret < 0 ? ret : -EIO;
+}
+
+/*
+** Tries to get the bus back after repeated failures, e.g. when the slave holds SDA low
+** after a glitch. Re-sends the conversion command so the converter is in a known state.
+*/
+static void adc_bus_recover(void)
+{
+    char cmd = INIT_MSG;
+    int ret = i2c_recover_bus(etx_i2c_client_adc->adapter);
+
+    bus_recoveries++;
+    if (ret < 0 && ret != -EOPNOTSUPP)
+    {
+        printk(KERN_WARNING "adc_driver: bus recovery failed %d\n", ret);
+    }
+    adc_transfer(&cmd, 1, 0);
+}
+
+/*
+** Performs one conversion with a bounded number of attempts.
+** Returns number of attempts used (>0) on success, negative error code otherwise.
+** Must be called with adc_lock held.
+*/
+static int adc_sample_once(u8 *flags)
+{
+    int attempt;
+    int ret = -EIO;
+
+    for (attempt = 0; attempt <= retries; attempt++)
+    {
+        if (attempt > 0)
+        {
+            read_retries++;
+            *flags |= ADC_FLAG_RETRIED;
+            usleep_range(retry_delay_us, retry_delay_us + 50);
+        }
+
+        ret = I2C_Write();
+        if (ret == 1)
+        {
+            ret = I2C_Read();
+        }
+        else if (ret >= 0)
+        {
+            ret = -EIO;
+        }
+
+        if (ret == 0)
+        {
+            consecutive_errors = 0;
+            last_good_time = ktime_get();
+            return attempt + 1;
+        }
+    }
+
+    read_errors++;
+    if (++consecutive_errors >= ADC_RECOVERY_THRESHOLD)
+    {
+        adc_bus_recover();
+        *flags |= ADC_FLAG_RECOVERED;
+        consecutive_errors = 0;
+    }
+
+    /* Bus timeouts are reported as such, everything else as an I/O error */
+    return ret == -ETIMEDOUT ? -ETIMEDOUT : -EIO;
 }
 
 /*
@@ -81,7 +279,9 @@ static int etx_adc_probe(struct i2c_client *client,
 */
 static int etx_adc_remove(struct i2c_client *client)
 {   
-    i2c_master_send(etx_i2c_client_adc, &EXIT_MSG, 1);
+    char cmd = EXIT_MSG;
+
+    adc_transfer(&cmd, 1, 0);
 
     /* After removing driver, just send shutdown message*/
     
@@ -89,51 +289,200 @@ static int etx_adc_remove(struct i2c_client *client)
     return 0;
 }
 
-/* File open function. */
+/* File open function, allocates per-open reader state. */
 static int adc_driver_open(struct inode *inode, struct file *filp)
 {
+    struct adc_reader *reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+
+    if (reader == NULL)
+    {
+        return -ENOMEM;
+    }
+    filp->private_data = reader;
     return 0;
 }
 
 /* File close function. */
 static int adc_driver_release(struct inode *inode, struct file *filp)
 {
+    kfree(filp->private_data);
     return 0;
 }
 
-/* 
-    Function that enables reading from char device driver, only necessary function for this project purpose
-    First uses I2C_Write to initiate conversion, then reads the data and finally sends it back to user-space application
+/*
+** Publishes the conversion just done in the ramp status page.
+** Must be called with adc_lock held.
 */
-static ssize_t adc_driver_read(struct file *filp, char *buf, size_t len, loff_t *f_pos)
+static void adc_publish(void)
+{
+    struct ramp_status *st;
+    unsigned long flags;
+
+    st = ramp_status_begin(&flags);
+    if (sample_err == 0)
+    {
+        st->sample_raw = ((data[0] & 0x0F) << 8) | (u8)data[1];
+        st->sample_ns = ktime_to_ns(last_good_time);
+    }
+    st->sample_flags = sample_flags | (sample_err < 0 ? ADC_FLAG_STALE : 0);
+    st->conversions = conversions;
+    st->read_errors = read_errors;
+    ramp_status_end(flags);
+}
+
+/* Sampling period of the current rate mode */
+static unsigned int adc_period_us(void)
+{
+    return READ_ONCE(rate_mode) == ADC_RATE_IDLE ? idle_period_us : active_period_us;
+}
+
+/*
+** Blocks until the next sampling slot of the current rate mode.
+** Returns 0 when the slot is reached, -ERESTARTSYS if interrupted by a signal.
+*/
+static int adc_wait_slot(void)
 {
-    int data_size = 0;
+    unsigned int gen;
+    ktime_t due;
+    s64 wait_us;
+    long ret;
 
-    if (*f_pos == 0)
+    while (1)
     {
-        I2C_Write();
-        I2C_Read();
-        if (copy_to_user(buf, data, 2) != 0)
+        gen = READ_ONCE(rate_generation);
+        due = ktime_add_us(READ_ONCE(last_conversion),
+                           adc_period_us());
+        wait_us = ktime_us_delta(due, ktime_get());
+        if (wait_us <= 0)
         {
-            return -EFAULT;
+            return 0;
         }
-        else
+
+        if (wait_us < ADC_SHORT_WAIT_US)
         {
-            (*f_pos) += data_size;
+            usleep_range(wait_us, wait_us + 100);
+            return 0;
+        }
 
-            return data_size;
+        /* Long idle wait, cut short when user-space switches the rate */
+        ret = wait_event_interruptible_timeout(rate_wq, READ_ONCE(rate_generation) != gen,
+                                               usecs_to_jiffies(wait_us));
+        if (ret < 0)
+        {
+            return -ERESTARTSYS;
         }
     }
-    else
+}
+
+/* 
+    Function that enables reading from char device driver, only necessary function for this project purpose
+    First uses I2C_Write to initiate conversion, then reads the data and finally sends it back to user-space application
+    Every read returns a sample this file has not seen yet, so file position is not used. Returns 2 bytes of raw data,
+    or struct adc_sample if len is big enough. Read first waits for the next sampling slot, the conversion itself never
+    takes longer than worst_case_us. Concurrent readers share the conversion of the current slot.
+*/
+static ssize_t adc_driver_read(struct file *filp, char *buf, size_t len, loff_t *f_pos)
+{
+    struct adc_reader *reader = filp->private_data;
+    struct adc_sample sample;
+    int data_size = 2;
+    int ret;
+
+    if (len < 2)
     {
-        return 0;
+        return -EINVAL;
+    }
+    if (len >= sizeof(sample))
+    {
+        data_size = sizeof(sample);
+    }
+
+    memset(&sample, 0, sizeof(sample));
+
+    ret = adc_wait_slot();
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    mutex_lock(&adc_lock);
+    if (sample_seq == reader->seq ||
+        ktime_us_delta(ktime_get(), last_conversion) >= adc_period_us())
+    {
+        /* Nothing new for this reader in the current slot, convert and publish */
+        WRITE_ONCE(last_conversion, ktime_get());
+        sample_flags = 0;
+        ret = adc_sample_once(&sample_flags);
+        sample_err = ret < 0 ? ret : 0;
+        sample_attempts = ret < 0 ? retries + 1 : ret;
+        sample_seq++;
+        adc_publish();
+    }
+    reader->seq = sample_seq;
+
+    if (sample_err < 0 && (data_size == 2 || ktime_to_ns(last_good_time) == 0))
+    {
+        ret = sample_err;
+        mutex_unlock(&adc_lock);
+        return ret;
+    }
+    sample.flags = sample_flags;
+    sample.attempts = sample_attempts;
+    if (sample_err < 0)
+    {
+        sample.flags |= ADC_FLAG_STALE;
+    }
+    sample.data[0] = data[0];
+    sample.data[1] = data[1];
+    sample.age_us = (u32)ktime_us_delta(ktime_get(), last_good_time);
+    mutex_unlock(&adc_lock);
+
+    if (copy_to_user(buf, &sample, data_size) != 0)
+    {
+        return -EFAULT;
     }
+
+    return data_size;
 }
 
-/* Write function, not needed for the project */
+/*
+    Write function, selects the sampling rate schedule:
+        "ACTIVE" - sample every active_period_us
+        "IDLE"   - sample every idle_period_us and power the converter down between conversions
+*/
 static ssize_t adc_driver_write(struct file *filp, const char *buf, size_t len, loff_t *f_pos)
 {
-    return 0;
+    char cmd[8];
+    size_t to_copy = min(len, sizeof(cmd) - 1);
+    int mode;
+
+    memset(cmd, 0, sizeof(cmd));
+    if (copy_from_user(cmd, buf, to_copy) != 0)
+    {
+        return -EFAULT;
+    }
+
+    if (strncmp(cmd, "ACTIVE", 6) == 0)
+    {
+        mode = ADC_RATE_ACTIVE;
+    }
+    else if (strncmp(cmd, "IDLE", 4) == 0)
+    {
+        mode = ADC_RATE_IDLE;
+    }
+    else
+    {
+        return -EINVAL;
+    }
+
+    if (mode != READ_ONCE(rate_mode))
+    {
+        WRITE_ONCE(rate_mode, mode);
+        WRITE_ONCE(rate_generation, rate_generation + 1);
+        wake_up_interruptible(&rate_wq);
+    }
+
+    return len;
 }
 
 /*
@@ -185,21 +534,36 @@ static int __init etx_driver_init(void)
     int result = -1;
     etx_i2c_adapter = i2c_get_adapter(I2C_BUS_AVAILABLE);
     
-    if( etx_i2c_adapter != NULL )
+    if( etx_i2c_adapter == NULL )
     {
-        etx_i2c_client_adc = i2c_new_device(etx_i2c_adapter, &adc_i2c_board_info);
-        
-        if( etx_i2c_client_adc != NULL )
-        {
-            i2c_add_driver(&etx_adc_driver);
-            ret = 0;
-        }
-        
+        printk(KERN_ERR "adc_driver: I2C bus %d not available\n", I2C_BUS_AVAILABLE);
+        return -ENODEV;
+    }
+
+    etx_i2c_client_adc = i2c_new_device(etx_i2c_adapter, &adc_i2c_board_info);
+    if( etx_i2c_client_adc == NULL )
+    {
+        printk(KERN_ERR "adc_driver: cannot create I2C device at 0x%x\n", ADC_SLAVE_ADDR);
         i2c_put_adapter(etx_i2c_adapter);
+        return -ENODEV;
+    }
+
+    /* The adapter reference is kept until exit, every transfer goes through it */
+    ret = i2c_add_driver(&etx_adc_driver);
+    if( ret < 0 )
+    {
+        i2c_unregister_device(etx_i2c_client_adc);
+        i2c_put_adapter(etx_i2c_adapter);
+        return ret;
     }
     
     pr_info("I2C driver added!!!\n");
 
+    /* Worst case read: every attempt times out on both transfers, then the bus is recovered */
+    worst_case_us = (retries + 1) * (2 * jiffies_to_usecs(msecs_to_jiffies(timeout_ms)) + retry_delay_us + 50)
+                    + ADC_RECOVERY_US;
+    printk(KERN_INFO "adc_driver: worst case read latency %u us\n", worst_case_us);
+
     printk(KERN_INFO "Inserting adc_driver module\n");
 
     /* Registering device. */
@@ -207,26 +571,52 @@ static int __init etx_driver_init(void)
     if (result < 0)
     {
         printk(KERN_INFO "adc_driver: cannot obtain major number %d\n", adc_driver_major);
+        i2c_del_driver(&etx_adc_driver);
+        i2c_unregister_device(etx_i2c_client_adc);
+        i2c_put_adapter(etx_i2c_adapter);
         return result;
     }
 
     adc_driver_major = result;
     printk(KERN_INFO "adc_driver major number is %d\n", adc_driver_major);
 
+    /* Device file, so no mknod is needed */
+    adc_class = ramp_class_get(ADC_CLASS);
+    ret = PTR_ERR_OR_ZERO(adc_class);
+    if( ret == 0 )
+    {
+        ret = PTR_ERR_OR_ZERO(device_create(adc_class, NULL, MKDEV(adc_driver_major, 0), NULL, "adc_driver"));
+        if( ret < 0 )
+        {
+            ramp_class_put(adc_class);
+        }
+    }
+    if( ret < 0 )
+    {
+        printk(KERN_ERR "adc_driver: cannot create device file\n");
+        unregister_chrdev(adc_driver_major, "adc_driver");
+        i2c_del_driver(&etx_adc_driver);
+        i2c_unregister_device(etx_i2c_client_adc);
+        i2c_put_adapter(etx_i2c_adapter);
+        return ret;
+    }
+
     return ret;
 }
 
 /*
 ** Module Exit function
 */
-static void __exit etx_driver_exit(void)
+static void RAMP_PART_EXIT etx_driver_exit(void)
 {
+    device_destroy(adc_class, MKDEV(adc_driver_major, 0));
+    ramp_class_put(adc_class);
     i2c_unregister_device(etx_i2c_client_adc);
     i2c_del_driver(&etx_adc_driver);
+    i2c_put_adapter(etx_i2c_adapter);
     unregister_chrdev(adc_driver_major, "adc_driver");
     pr_info("I2C driver Removed!!!\n");
     pr_info("adc_driver removed!\n");
 }
 
-module_init(etx_driver_init);
-module_exit(etx_driver_exit);
\ No newline at end of file
+RAMP_PART(adc, etx_driver_init, etx_driver_exit)
\ No newline at end of file
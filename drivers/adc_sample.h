@@ -0,0 +1,28 @@
+#ifndef ADC_SAMPLE_H
+#define ADC_SAMPLE_H
+
+/*
+ * Extended sample of adc_driver, returned when the reader asks for at least sizeof(struct adc_sample)
+ * bytes from /dev/adc_driver. On failure plain 2 byte readers get an error code, extended readers get
+ * the last good sample marked ADC_FLAG_STALE together with its age, or the error if there was no good
+ * sample yet. The flags are also published as sample_flags of the status page.
+ * Shared between the kernel module and user-space.
+ */
+
+#include <linux/types.h>
+
+#define ADC_DEVICE             "/dev/adc_driver"
+
+/* Sample flags */
+#define ADC_FLAG_STALE         (0x01)  /* data is the last good sample, current read failed */
+#define ADC_FLAG_RETRIED       (0x02)  /* sample needed more than one attempt */
+#define ADC_FLAG_RECOVERED     (0x04)  /* bus recovery was performed during this read */
+
+struct adc_sample {
+    __u8  data[2];          /* 12-bit sample, 4 MSBs of data[0] unused */
+    __u8  flags;            /* ADC_FLAG_* */
+    __u8  attempts;         /* Attempts used, retries + 1 after a failure */
+    __u32 age_us;           /* Time since data was converted */
+};
+
+#endif
@@ -5,6 +5,9 @@
 #include <linux/uaccess.h>
 #include <linux/pwm.h>
 #include <linux/delay.h>
+#include <linux/mutex.h>
+#include "ramp_status.h"
+#include "ramp_module.h"
 
 /* Meta Information */
 MODULE_LICENSE("Dual BSD/GPL");
@@ -20,12 +23,30 @@ static struct cdev my_device;
 #define DRIVER_CLASS "BuzzerClass"
 
 /* Variables for PWM  */
-struct pwm_device *pwm0 = NULL;
+static struct pwm_device *pwm0 = NULL;
+
+/* Serializes buzzing between concurrent writers, one beep at a time */
+static DEFINE_MUTEX(pwm0_lock);
 
 /* duty cycle of PWM
     ** will be passed as an argument to function pwm_config  
 */
 
+/**
+ * @brief Publishes buzzer state in the ramp status page
+ */
+static void publish_buzzer(u8 on) {
+    struct ramp_status *st;
+    unsigned long flags;
+
+    st = ramp_status_begin(&flags);
+    st->buzzer = on;
+    st->buzzer_ns = ktime_get_ns();
+    if(on)
+        st->buzzes++;
+    ramp_status_end(flags);
+}
+
 /**
  * @brief Write data to buffer
  */
@@ -38,19 +59,25 @@ static ssize_t driver_write(struct file *File, const char *user_buffer, size_t c
 
     /* Copy data to user */
     not_copied = copy_from_user(&value, user_buffer, to_copy);
+    if(to_copy == 0 || not_copied != 0)
+        return -EFAULT;
 
-    printk("%s\n", user_buffer);
+    printk("%c\n", value);
 
     /* Set PWM on time: a - stop buzzing ; b - start buzzing */
+    mutex_lock(&pwm0_lock);
     if(value != 'a' && value != 'b')
         printk("Invalid Value\n");
     else
         pwm_config(pwm0, 1000000 * (value - 'a'), 2600000);
 
     if(value == 'b'){
+        publish_buzzer(1);
         msleep(1000);
     }
     pwm_config(pwm0, 0, 2600000);
+    publish_buzzer(0);
+    mutex_unlock(&pwm0_lock);
 
     /* Calculate data */
     delta = to_copy - not_copied;
@@ -85,23 +112,38 @@ static struct file_operations fops = {
  * @brief This function is called, when the module is loaded into the kernel
  */
 static int __init ModuleInit(void) {
+    int ret;
+
     printk("buzz_driver!\n");
 
+    /* Buzzer silent before the device file appears */
+    pwm0 = pwm_request(1, "buzz-pwm");
+    if(IS_ERR(pwm0)) {
+        printk("Could not get PWM0!\n");
+        return PTR_ERR(pwm0);
+    }
+
+    pwm_config(pwm0, 0, 20000000);
+    pwm_enable(pwm0);
+    publish_buzzer(0);
+
     /* Allocate a device nr */
-    if( alloc_chrdev_region(&my_device_nr, 0, 1, DRIVER_NAME) < 0) {
+    if((ret = alloc_chrdev_region(&my_device_nr, 0, 1, DRIVER_NAME)) < 0) {
         printk("buzz_driver Nr. could not be allocated!\n");
-        return -1;
+        goto NrError;
     }
     printk("read_write - Device Nr. Major: %d, Minor: %d was registered!\n", my_device_nr >> 20, my_device_nr && 0xfffff);
 
     /* Create device class */
-    if((my_class = class_create(THIS_MODULE, DRIVER_CLASS)) == NULL) {
+    my_class = ramp_class_get(DRIVER_CLASS);
+    if(IS_ERR(my_class)) {
         printk("Device class can not be created!\n");
+        ret = PTR_ERR(my_class);
         goto ClassError;
     }
 
     /* create device file */
-    if(device_create(my_class, NULL, my_device_nr, NULL, DRIVER_NAME) == NULL) {
+    if((ret = PTR_ERR_OR_ZERO(device_create(my_class, NULL, my_device_nr, NULL, DRIVER_NAME))) < 0) {
         printk("Can not create device file!\n");
         goto FileError;
     }
@@ -110,42 +152,34 @@ static int __init ModuleInit(void) {
     cdev_init(&my_device, &fops);
 
     /* Regisering device to kernel */
-    if(cdev_add(&my_device, my_device_nr, 1) == -1) {
+    if((ret = cdev_add(&my_device, my_device_nr, 1)) < 0) {
         printk("Registering of device to kernel failed!\n");
         goto AddError;
     }
 
-    pwm0 = pwm_request(1, "buzz-pwm");
-    if(pwm0 == NULL) {
-        printk("Could not get PWM0!\n");
-        goto AddError;
-    }
-
-    pwm_config(pwm0, 0, 20000000);
-    pwm_enable(pwm0);
-
     return 0;
 AddError:
     device_destroy(my_class, my_device_nr);
 FileError:
-    class_destroy(my_class);
+    ramp_class_put(my_class);
 ClassError:
     unregister_chrdev_region(my_device_nr, 1);
-    return -1;
+NrError:
+    pwm_free(pwm0);
+    return ret;
 }
 
 /**
  * @brief This function is called, when the module is removed from the kernel
  */
-static void __exit ModuleExit(void) {
+static void RAMP_PART_EXIT ModuleExit(void) {
     pwm_disable(pwm0);
     pwm_free(pwm0);
     cdev_del(&my_device);
     device_destroy(my_class, my_device_nr);
-    class_destroy(my_class);
+    ramp_class_put(my_class);
     unregister_chrdev_region(my_device_nr, 1);
     printk("buzz_driver exit\n");
 }
 
-module_init(ModuleInit);
-module_exit(ModuleExit);
\ No newline at end of file
+RAMP_PART(buzz, ModuleInit, ModuleExit)
@@ -0,0 +1,30 @@
+#ifndef GPIO_INPUT_H
+#define GPIO_INPUT_H
+
+/*
+ * Events of the discrete inputs of led_driver (induction loops, push-buttons, emergency stops),
+ * read from /dev/gpio_inputs. Inputs are numbered in the order of the input_pins module parameter.
+ * Every read returns whole events; the first ones after open report the current level of each
+ * input with GPIO_INPUT_INITIAL set. seq increases by one per change, a gap means events were lost
+ * because the reader fell behind. Times are CLOCK_MONOTONIC in nanoseconds, taken in the interrupt.
+ * Shared between the kernel module and user-space.
+ */
+
+#include <linux/types.h>
+
+#define GPIO_INPUT_DEVICE      "/dev/gpio_inputs"
+#define GPIO_INPUT_MAX         (8)
+
+/* Event flags */
+#define GPIO_INPUT_INITIAL     (0x01)  /* Current level reported after open, not a change */
+
+struct gpio_input_event {
+    __u64 t_ns;             /* Time of the edge */
+    __u32 seq;              /* Change counter over all inputs */
+    __u8  input;            /* Index into input_pins */
+    __u8  active;           /* 1 while the input is active, polarity already applied */
+    __u8  flags;            /* GPIO_INPUT_* */
+    __u8  reserved;
+};
+
+#endif
@@ -13,6 +13,19 @@
 #include <linux/hrtimer.h>
 #include <asm/io.h>
 #include <linux/uaccess.h>
+#include <linux/moduleparam.h>
+#include <linux/timekeeping.h>
+#include <linux/mm.h>
+#include <linux/capability.h>
+#include <linux/spinlock.h>
+#include <linux/gpio.h>
+#include <linux/interrupt.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include "ramp_status.h"
+#include "gpio_input.h"
+#include "ramp_seq.h"
+#include "ramp_module.h"
 
 MODULE_LICENSE("Dual BSD/GPL");
 
@@ -139,6 +152,77 @@ const char* RED = "RED";
 const char* YELLOW = "YELLOW";
 const char* GREEN = "GREEN";
 
+/* Heartbeat message, arms the watchdog on first use */
+const char* WD_KICK = "HB";
+
+/*
+ * Watchdog: once user-space sends heartbeats, missing them for wd_timeout_ms turns
+ * the red light on straight from the hrtimer callback, so the safe state is reached
+ * within wd_timeout_ms plus hrtimer slack regardless of user-space state.
+ */
+static unsigned int wd_timeout_ms = 500;
+RAMP_PARAM(led, wd_timeout_ms, uint, 0644);
+RAMP_PARAM_DESC(led, wd_timeout_ms, "Heartbeat timeout before red light is forced");
+
+static unsigned int wd_trips;
+RAMP_PARAM(led, wd_trips, uint, 0444);
+RAMP_PARAM_DESC(led, wd_trips, "Number of watchdog expirations");
+
+static unsigned long wd_last_trip;
+RAMP_PARAM(led, wd_last_trip, ulong, 0444);
+RAMP_PARAM_DESC(led, wd_last_trip, "Wall clock seconds of the last watchdog expiration");
+
+static struct hrtimer wd_timer;
+
+/*
+ * Discrete inputs: pins listed in input_pins are configured as inputs with edge interrupts.
+ * The first edge is reported at once with the interrupt timestamp, further edges within
+ * debounce_us are ignored and the level is checked again when the debounce period ends,
+ * so contact bounce costs one event at most and no polling is needed.
+ */
+static int input_pins[GPIO_INPUT_MAX];
+static int input_count;
+module_param_array(input_pins, int, &input_count, 0444);
+MODULE_PARM_DESC(input_pins, "BCM numbers of input pins, e.g. input_pins=17,27");
+
+static unsigned int debounce_us = 5000;
+module_param(debounce_us, uint, 0644);
+MODULE_PARM_DESC(debounce_us, "Input debounce period in us");
+
+static int input_pull = PULL_UP;
+module_param(input_pull, int, 0444);
+MODULE_PARM_DESC(input_pull, "Internal pull resistor of inputs: 0 none, 1 down, 2 up");
+
+static int input_active_low = 1;
+module_param(input_active_low, int, 0444);
+MODULE_PARM_DESC(input_active_low, "Inputs are active at low level (contact to ground)");
+
+struct gpio_input {
+    int pin;
+    int irq;
+    u8 active;              /* Last reported level */
+    u8 lockout;             /* Debounce period running, edges are ignored */
+    u64 changed_ns;         /* Time of the last reported change */
+    struct hrtimer debounce;
+};
+
+/* Per-open reader position in the event ring */
+struct input_reader {
+    u32 tail;
+    u32 initial;            /* Inputs whose current level is still to be reported */
+};
+
+#define INPUT_MINOR    (1)
+#define INPUT_RING_LEN (64)
+
+static struct gpio_input inputs[GPIO_INPUT_MAX];
+static struct gpio_input_event input_ring[INPUT_RING_LEN];
+static u32 input_head;
+static DECLARE_WAIT_QUEUE_HEAD(input_wq);
+
+/* Protects inputs and input_ring, taken from interrupt and hrtimer context. */
+static DEFINE_SPINLOCK(input_lock);
+
 /* Declaration of gpio_driver.c functions */
 int gpio_driver_init(void);
 void gpio_driver_exit(void);
@@ -146,6 +230,8 @@ static int gpio_driver_open(struct inode *, struct file *);
 static int gpio_driver_release(struct inode *, struct file *);
 static ssize_t gpio_driver_read(struct file *, char *buf, size_t , loff_t *);
 static ssize_t gpio_driver_write(struct file *, const char *buf, size_t , loff_t *);
+static int gpio_driver_mmap(struct file *, struct vm_area_struct *);
+static unsigned int gpio_driver_poll(struct file *, poll_table *);
 
 /* Structure that declares the usual file access functions. */
 struct file_operations gpio_driver_fops =
@@ -153,22 +239,30 @@ struct file_operations gpio_driver_fops =
     open    :   gpio_driver_open,
     release :   gpio_driver_release,
     read    :   gpio_driver_read,
-    write   :   gpio_driver_write
+    write   :   gpio_driver_write,
+    mmap    :   gpio_driver_mmap,
+    poll    :   gpio_driver_poll
 };
 
 /* Declaration of the init and exit functions. */
-module_init(gpio_driver_init);
-module_exit(gpio_driver_exit);
+RAMP_PART(led, gpio_driver_init, gpio_driver_exit)
 
 /* Global variables of the driver */
 
 /* Major number. */
 int gpio_driver_major;
 
+/* Device class and file, shared class when built into ramp.ko */
+static struct class *led_class;
+#define LED_CLASS "LedClass"
+
 /* Buffer to store data. */
 #define BUF_LEN 10
 char* led_buff;
 
+/* Protects led_buff and light changes, taken from the watchdog hrtimer as well. */
+static DEFINE_SPINLOCK(led_lock);
+
 /* Virtual address where the physical GPIO address is mapped */
 void* virt_gpio_base;
 
@@ -385,13 +479,281 @@ char GetGpioPinValue(char pin)
     return (tmp >> pin);
 }
 
+/* Who changed the light, see PublishLight */
+typedef enum {LIGHT_BY_USER = 0, LIGHT_BY_WATCHDOG = 1, LIGHT_BY_INIT = 2} LIGHT_SOURCE;
+
+/*
+ * PublishLight function
+ *  Parameters:
+ *   light     - RAMP_LIGHT_* value now shown;
+ *   source    - LIGHT_BY_USER, LIGHT_BY_WATCHDOG or LIGHT_BY_INIT
+ *  Operation:
+ *   Updates the light in the ramp status page. The first light set by user-space
+ *   marks the end of startup.
+ */
+static void PublishLight(u8 light, LIGHT_SOURCE source)
+{
+    struct ramp_status *st;
+    unsigned long flags;
+
+    st = ramp_status_begin(&flags);
+    st->light = light;
+    st->light_ns = ktime_get_ns();
+    st->light_changes++;
+    if(source == LIGHT_BY_WATCHDOG)
+        st->led_wd_trips++;
+    if(source == LIGHT_BY_USER && st->first_phase_ns == 0)
+        st->first_phase_ns = st->light_ns;
+    ramp_status_end(flags);
+}
+
+/*
+ * WatchdogExpired function
+ *  Operation:
+ *   Called from hrtimer when heartbeats stopped. Turns the red light on and
+ *   records the expiration.
+ */
+static enum hrtimer_restart WatchdogExpired(struct hrtimer *timer)
+{
+    spin_lock(&led_lock);
+    SetGpioPin(GPIO_05);
+    ClearGpioPin(GPIO_06);
+    ClearGpioPin(GPIO_26);
+    strcpy(led_buff, RED);
+    spin_unlock(&led_lock);
+    PublishLight(RAMP_LIGHT_RED, LIGHT_BY_WATCHDOG);
+
+    wd_trips++;
+    wd_last_trip = ktime_get_real_seconds();
+    printk(KERN_WARNING "led_driver: watchdog expired, red light on\n");
+
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * ShowLight function
+ *  Parameters:
+ *   light     - RAMP_LIGHT_* value to show;
+ *   source    - LIGHT_BY_USER or LIGHT_BY_INIT
+ *  Operation:
+ *   Drives the LED pins, pins and led_buff change together. Safe from any context.
+ */
+static void ShowLight(u8 light, LIGHT_SOURCE source)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&led_lock, flags);
+    switch(light)
+    {
+        case RAMP_LIGHT_RED:
+            SetGpioPin(GPIO_05);
+            ClearGpioPin(GPIO_06);
+            ClearGpioPin(GPIO_26);
+            strcpy(led_buff, RED);
+            break;
+        case RAMP_LIGHT_YELLOW:
+            ClearGpioPin(GPIO_05);
+            SetGpioPin(GPIO_06);
+            ClearGpioPin(GPIO_26);
+            strcpy(led_buff, YELLOW);
+            break;
+        case RAMP_LIGHT_GREEN:
+            ClearGpioPin(GPIO_05);
+            ClearGpioPin(GPIO_06);
+            SetGpioPin(GPIO_26);
+            strcpy(led_buff, GREEN);
+            break;
+        default:
+            ClearGpioPin(GPIO_05);
+            ClearGpioPin(GPIO_06);
+            ClearGpioPin(GPIO_26);
+            led_buff[0] = '\0';
+            light = RAMP_LIGHT_OFF;
+            break;
+    }
+    spin_unlock_irqrestore(&led_lock, flags);
+    PublishLight(light, source);
+}
+
+/*
+ * ramp_led_set function
+ *  Parameters:
+ *   light     - RAMP_LIGHT_* value to show
+ *  Operation:
+ *   Sets the light for ramp_seq, callable from its hrtimer.
+ */
+void ramp_led_set(u8 light)
+{
+    ShowLight(light, LIGHT_BY_USER);
+}
+EXPORT_SYMBOL(ramp_led_set);
+
+/*
+ * InputUpdate function
+ *  Parameters:
+ *   in        - input to check;
+ *   t_ns      - time of the edge;
+ *
+ *   return    - 1 if a change was queued, 0 if the level is the one last reported
+ *  Operation:
+ *   Reads the input level and queues an event when it differs from the last reported
+ *   one. Must be called with input_lock held.
+ */
+static int InputUpdate(struct gpio_input *in, u64 t_ns)
+{
+    struct gpio_input_event *ev;
+    u8 active = GetGpioPinValue(in->pin) ^ (input_active_low ? 1 : 0);
+
+    if(active == in->active)
+        return 0;
+
+    in->active = active;
+    in->changed_ns = t_ns;
+    ev = &input_ring[input_head % INPUT_RING_LEN];
+    ev->t_ns = t_ns;
+    ev->seq = input_head;
+    ev->input = in - inputs;
+    ev->active = active;
+    ev->flags = 0;
+    input_head++;
+    wake_up_interruptible(&input_wq);
+    return 1;
+}
+
+/*
+ * InputIrq function
+ *  Operation:
+ *   Edge interrupt of an input. Outside of the debounce period the new level is
+ *   reported at once and the debounce period is started.
+ */
+static irqreturn_t InputIrq(int irq, void *dev_id)
+{
+    struct gpio_input *in = dev_id;
+    u64 t_ns = ktime_get_ns();
+    unsigned long flags;
+
+    spin_lock_irqsave(&input_lock, flags);
+    if(!in->lockout)
+    {
+        InputUpdate(in, t_ns);
+        in->lockout = 1;
+        hrtimer_start(&in->debounce, ns_to_ktime((u64)debounce_us * 1000), HRTIMER_MODE_REL);
+    }
+    spin_unlock_irqrestore(&input_lock, flags);
+
+    return IRQ_HANDLED;
+}
+
+/*
+ * InputDebounced function
+ *  Operation:
+ *   End of a debounce period. A level that changed during the period is reported
+ *   now and starts another period, otherwise edges are accepted again.
+ */
+static enum hrtimer_restart InputDebounced(struct hrtimer *timer)
+{
+    struct gpio_input *in = container_of(timer, struct gpio_input, debounce);
+    enum hrtimer_restart ret = HRTIMER_NORESTART;
+    unsigned long flags;
+
+    spin_lock_irqsave(&input_lock, flags);
+    if(InputUpdate(in, ktime_get_ns()))
+    {
+        hrtimer_forward_now(timer, ns_to_ktime((u64)debounce_us * 1000));
+        ret = HRTIMER_RESTART;
+    }
+    else
+    {
+        in->lockout = 0;
+    }
+    spin_unlock_irqrestore(&input_lock, flags);
+
+    return ret;
+}
+
+/*
+ * InputsExit function
+ *  Parameters:
+ *   count     - number of inputs to release
+ *  Operation:
+ *   Frees interrupts and pins of the first count inputs.
+ */
+static void InputsExit(int count)
+{
+    int i;
+
+    for(i = 0; i < count; i++)
+    {
+        free_irq(inputs[i].irq, &inputs[i]);
+        hrtimer_cancel(&inputs[i].debounce);
+        gpio_free(inputs[i].pin);
+    }
+}
+
+/*
+ * InputsInit function
+ *  Operation:
+ *   Configures the pins in input_pins as inputs with the selected pull resistor and
+ *   requests an interrupt on both edges for each. LED, I2C (ADC) and PWM (servo) pins
+ *   can not be used.
+ */
+static int InputsInit(void)
+{
+    struct gpio_input *in;
+    int result;
+    int i;
+
+    for(i = 0; i < input_count; i++)
+    {
+        in = &inputs[i];
+        in->pin = input_pins[i];
+        if(in->pin < GPIO_04 || in->pin > GPIO_27 || in->pin == GPIO_05 || in->pin == GPIO_06 ||
+           in->pin == GPIO_18 || in->pin == GPIO_26)
+        {
+            printk(KERN_ERR "led_driver: GPIO %d can not be used as input\n", in->pin);
+            result = -EINVAL;
+            goto fail_input;
+        }
+
+        result = gpio_request(in->pin, "ramp_input");
+        if(result < 0)
+        {
+            goto fail_input;
+        }
+        SetGpioPinDirection(in->pin, GPIO_DIRECTION_IN);
+        SetInternalPullUpDown(in->pin, input_pull);
+        in->active = GetGpioPinValue(in->pin) ^ (input_active_low ? 1 : 0);
+        in->changed_ns = ktime_get_ns();
+        in->lockout = 0;
+        hrtimer_init(&in->debounce, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+        in->debounce.function = InputDebounced;
+
+        in->irq = gpio_to_irq(in->pin);
+        result = in->irq < 0 ? in->irq :
+                 request_irq(in->irq, InputIrq, IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING, "ramp_input", in);
+        if(result < 0)
+        {
+            gpio_free(in->pin);
+            goto fail_input;
+        }
+    }
+
+    return 0;
+
+fail_input:
+    InputsExit(i);
+    return result;
+}
+
 /*
  * Initialization:
  *  1. Register device driver
  *  2. Allocate buffer
  *  3. Initialize buffer
  *  4. Map GPIO Physical address space to virtual address
- *  5. Initialize GPIO pins
+ *  5. Initialize GPIO pins, red light on as the safe state until user-space takes over
+ *  6. Set up input pins and their interrupts
+ *  7. Create device files, inputs first so both exist once led_driver appears
  */
 int gpio_driver_init(void)
 {
@@ -434,9 +796,52 @@ int gpio_driver_init(void)
     SetGpioPinDirection(GPIO_05, GPIO_DIRECTION_OUT);
     SetGpioPinDirection(GPIO_06, GPIO_DIRECTION_OUT);
     SetGpioPinDirection(GPIO_26, GPIO_DIRECTION_OUT);
+    SetGpioPin(GPIO_05);
+    ClearGpioPin(GPIO_06);
+    ClearGpioPin(GPIO_26);
+    strcpy(led_buff, RED);
+    PublishLight(RAMP_LIGHT_RED, LIGHT_BY_INIT);
+
+    /* Watchdog timer, started by the first heartbeat. */
+    hrtimer_init(&wd_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    wd_timer.function = WatchdogExpired;
+
+    /* Discrete inputs. */
+    result = InputsInit();
+    if (result < 0)
+    {
+        goto fail_no_inputs;
+    }
+
+    /* Device files, so no mknod is needed. */
+    led_class = ramp_class_get(LED_CLASS);
+    if (IS_ERR(led_class))
+    {
+        result = PTR_ERR(led_class);
+        goto fail_no_class;
+    }
+    result = PTR_ERR_OR_ZERO(device_create(led_class, NULL, MKDEV(gpio_driver_major, INPUT_MINOR), NULL, "gpio_inputs"));
+    if (result < 0)
+    {
+        goto fail_no_input_device;
+    }
+    result = PTR_ERR_OR_ZERO(device_create(led_class, NULL, MKDEV(gpio_driver_major, 0), NULL, "led_driver"));
+    if (result < 0)
+    {
+        goto fail_no_device;
+    }
 
     return 0;
 
+fail_no_device:
+    device_destroy(led_class, MKDEV(gpio_driver_major, INPUT_MINOR));
+fail_no_input_device:
+    ramp_class_put(led_class);
+fail_no_class:
+    InputsExit(input_count);
+fail_no_inputs:
+    ClearGpioPin(GPIO_05);
+    iounmap(virt_gpio_base);
 fail_no_virt_mem:
     /* Freeing buffer gpio_driver_buffer. */
     if (led_buff)
@@ -461,6 +866,14 @@ void gpio_driver_exit(void)
 {
     printk(KERN_INFO "Removing led_driver module\n");
 
+    device_destroy(led_class, MKDEV(gpio_driver_major, 0));
+    device_destroy(led_class, MKDEV(gpio_driver_major, INPUT_MINOR));
+    ramp_class_put(led_class);
+
+    /* Stop watchdog and inputs before GPIO is unmapped. */
+    hrtimer_cancel(&wd_timer);
+    InputsExit(input_count);
+
     /* Clear GPIO pins. */
     ClearGpioPin(GPIO_05);
     ClearGpioPin(GPIO_06);
@@ -482,19 +895,156 @@ void gpio_driver_exit(void)
     unregister_chrdev(gpio_driver_major, "led_driver");
 }
 
-/* File open function. */
+/* Returns 1 if the file is /dev/gpio_inputs, 0 for /dev/led_driver. */
+static int IsInputFile(struct file *filp)
+{
+    return iminor(file_inode(filp)) == INPUT_MINOR;
+}
+
+/* File open function, input readers start at the current levels and the newest event. */
 static int gpio_driver_open(struct inode *inode, struct file *filp)
 {
+    struct input_reader *reader;
+    unsigned long flags;
+
+    if (iminor(inode) != INPUT_MINOR)
+    {
+        return 0;
+    }
+
+    reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+    if (reader == NULL)
+    {
+        return -ENOMEM;
+    }
+    spin_lock_irqsave(&input_lock, flags);
+    reader->tail = input_head;
+    reader->initial = (1u << input_count) - 1;
+    spin_unlock_irqrestore(&input_lock, flags);
+    filp->private_data = reader;
     return 0;
 }
 
 /* File close function. */
 static int gpio_driver_release(struct inode *inode, struct file *filp)
 {
-    /* Success. */
+    kfree(filp->private_data);
     return 0;
 }
 
+/* Returns 1 if the reader has events to read, must be called with input_lock held. */
+static int InputPendingLocked(struct input_reader *reader)
+{
+    return reader->initial != 0 || reader->tail != input_head;
+}
+
+static int InputPending(struct input_reader *reader)
+{
+    unsigned long flags;
+    int pending;
+
+    spin_lock_irqsave(&input_lock, flags);
+    pending = InputPendingLocked(reader);
+    spin_unlock_irqrestore(&input_lock, flags);
+    return pending;
+}
+
+/*
+ * InputNext function
+ *  Parameters:
+ *   reader    - reader position;
+ *   ev        - filled with the next event;
+ *
+ *   return    - 1 if an event was taken, 0 if none is pending
+ *  Operation:
+ *   Takes the current levels first, then changes in order. A reader that fell behind
+ *   by more than the ring continues with the oldest event still held.
+ */
+static int InputNext(struct input_reader *reader, struct gpio_input_event *ev)
+{
+    unsigned long flags;
+    int i;
+
+    spin_lock_irqsave(&input_lock, flags);
+    if (!InputPendingLocked(reader))
+    {
+        spin_unlock_irqrestore(&input_lock, flags);
+        return 0;
+    }
+    if (reader->initial != 0)
+    {
+        i = __ffs(reader->initial);
+        reader->initial &= ~(1u << i);
+        ev->t_ns = inputs[i].changed_ns;
+        ev->seq = input_head;
+        ev->input = i;
+        ev->active = inputs[i].active;
+        ev->flags = GPIO_INPUT_INITIAL;
+        ev->reserved = 0;
+    }
+    else
+    {
+        if (input_head - reader->tail > INPUT_RING_LEN)
+        {
+            reader->tail = input_head - INPUT_RING_LEN;
+        }
+        *ev = input_ring[reader->tail % INPUT_RING_LEN];
+        reader->tail++;
+    }
+    spin_unlock_irqrestore(&input_lock, flags);
+    return 1;
+}
+
+/*
+ * InputRead function
+ *  Operation:
+ *   Returns as many whole struct gpio_input_event as fit in len, blocking until
+ *   at least one is available unless the file is non-blocking.
+ */
+static ssize_t InputRead(struct file *filp, char *buf, size_t len)
+{
+    struct input_reader *reader = filp->private_data;
+    struct gpio_input_event ev;
+    size_t done = 0;
+
+    if (len < sizeof(ev))
+    {
+        return -EINVAL;
+    }
+    if (!InputPending(reader))
+    {
+        if (filp->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(input_wq, InputPending(reader)))
+        {
+            return -ERESTARTSYS;
+        }
+    }
+
+    while (done + sizeof(ev) <= len && InputNext(reader, &ev))
+    {
+        if (copy_to_user(buf + done, &ev, sizeof(ev)) != 0)
+        {
+            return done ? done : -EFAULT;
+        }
+        done += sizeof(ev);
+    }
+    return done;
+}
+
+/* File poll function, only input files become readable. */
+static unsigned int gpio_driver_poll(struct file *filp, poll_table *wait)
+{
+    if (!IsInputFile(filp))
+    {
+        return 0;
+    }
+    poll_wait(filp, &input_wq, wait);
+    return InputPending(filp->private_data) ? (POLLIN | POLLRDNORM) : 0;
+}
+
 /*
  * ~ NOT NECESSARY FOR THE WANTED USAGE ~
  * File read function
@@ -512,14 +1062,26 @@ static ssize_t gpio_driver_read(struct file *filp, char *buf, size_t len, loff_t
 {
     /* Size of valid data in gpio_driver - data to send in user space. */
     int data_size = 0;
+    char snapshot[BUF_LEN];
+    unsigned long flags;
+
+    if (IsInputFile(filp))
+    {
+        return InputRead(filp, buf, len);
+    }
 
     if (*f_pos == 0)
     {
+        /* Take a consistent copy, writers may change the light concurrently. */
+        spin_lock_irqsave(&led_lock, flags);
+        memcpy(snapshot, led_buff, BUF_LEN);
+        spin_unlock_irqrestore(&led_lock, flags);
+
         /* Get size of valid data. */
-        data_size = strlen(led_buff);
+        data_size = min(strnlen(snapshot, BUF_LEN), len);
 
         /* Send data to user space. */
-        if (copy_to_user(buf, led_buff, data_size) != 0)
+        if (copy_to_user(buf, snapshot, data_size) != 0)
         {
             return -EFAULT;
         }
@@ -549,42 +1111,88 @@ static ssize_t gpio_driver_read(struct file *filp, char *buf, size_t len, loff_t
  */
 static ssize_t gpio_driver_write(struct file *filp, const char *buf, size_t len, loff_t *f_pos)
 {
+    /* Message is parsed from a local buffer, at most BUF_LEN - 1 bytes are taken from user space. */
+    char msg[BUF_LEN];
+    size_t to_copy = min(len, (size_t)(BUF_LEN - 1));
+    u8 light;
+
+    if (IsInputFile(filp))
+    {
+        return -EINVAL;
+    }
+
     /* Reset memory. */
-    memset(led_buff, 0, BUF_LEN);
+    memset(msg, 0, BUF_LEN);
 
     /* Get data from user space.*/
-    if (copy_from_user(led_buff, buf, len) != 0)
+    if (copy_from_user(msg, buf, to_copy) != 0)
     {
         return -EFAULT;
     }
     else
     {
-        /* Turn the correct LED ON */
+        /* Heartbeat, re-arm the watchdog and leave the LEDs alone */
+        if(strcmp(WD_KICK,msg) == 0){
+            hrtimer_start(&wd_timer, ms_to_ktime(wd_timeout_ms), HRTIMER_MODE_REL);
+            return len;
+        }
 
-        if(strcmp(RED,led_buff) == 0){
-            printk(KERN_INFO "Red light on\n");
-            SetGpioPin(GPIO_05);
-            ClearGpioPin(GPIO_06);
-            ClearGpioPin(GPIO_26);
+        /* Turn the correct LED ON */
+        if(strcmp(RED,msg) == 0){
+            light = RAMP_LIGHT_RED;
         }
-        else if(strcmp(YELLOW,led_buff) == 0){
-            printk(KERN_INFO "Yellow light on\n");
-            ClearGpioPin(GPIO_05);
-            SetGpioPin(GPIO_06);
-            ClearGpioPin(GPIO_26);
+        else if(strcmp(YELLOW,msg) == 0){
+            light = RAMP_LIGHT_YELLOW;
         }
-        else if(strcmp(GREEN, led_buff) == 0){
-            printk(KERN_INFO "Green light on\n");
-            ClearGpioPin(GPIO_05);
-            ClearGpioPin(GPIO_06);
-            SetGpioPin(GPIO_26);
+        else if(strcmp(GREEN, msg) == 0){
+            light = RAMP_LIGHT_GREEN;
         }
         else{
-            printk(KERN_INFO "Lights off\n");
-            ClearGpioPin(GPIO_05);
-            ClearGpioPin(GPIO_06);
-            ClearGpioPin(GPIO_26);
+            msg[0] = '\0';
+            light = RAMP_LIGHT_OFF;
         }
+        ShowLight(light, LIGHT_BY_USER);
+
+        if(msg[0])
+            printk(KERN_INFO "%s light on\n", msg);
+        else
+            printk(KERN_INFO "Lights off\n");
         return len;
     }
 }
+
+/*
+ * File mmap function
+ *  Parameters:
+ *   filp  - a type file structure;
+ *   vma   - user-space mapping being created;
+ *  Operation:
+ *   Maps the GPIO register page uncached into user space, so a privileged controller can
+ *   change lights through GPSET0/GPCLR0 and read levels through GPLEV0 without a syscall.
+ *   MMU works with whole pages, so the mapping is exactly the one page at GPIO_BASE and the
+ *   caller must have CAP_SYS_RAWIO, as the page also holds the function select registers.
+ */
+static int gpio_driver_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    unsigned long size = vma->vm_end - vma->vm_start;
+
+    if (IsInputFile(filp))
+    {
+        return -ENODEV;
+    }
+    if (!capable(CAP_SYS_RAWIO))
+    {
+        return -EPERM;
+    }
+
+    /* Only one page at offset 0, no growing with mremap. */
+    if (vma->vm_pgoff != 0 || size != PAGE_SIZE)
+    {
+        return -EINVAL;
+    }
+
+    vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+    vma->vm_flags |= VM_IO | VM_DONTEXPAND | VM_DONTDUMP;
+
+    return io_remap_pfn_range(vma, vma->vm_start, GPIO_BASE >> PAGE_SHIFT, size, vma->vm_page_prot);
+}
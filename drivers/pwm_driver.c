@@ -4,6 +4,14 @@
 #include <linux/cdev.h>
 #include <linux/uaccess.h>
 #include <linux/pwm.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/moduleparam.h>
+#include <linux/timekeeping.h>
+#include <linux/mutex.h>
+#include "ramp_status.h"
+#include "ramp_seq.h"
+#include "ramp_module.h"
 
 /* Meta Information */
 MODULE_LICENSE("Dual BSD/GPL");
@@ -19,13 +27,85 @@ static struct cdev my_device;
 #define DRIVER_CLASS "MyModuleClass"
 
 /* Variables for PWM  */
-struct pwm_device *pwm0 = NULL;
+static struct pwm_device *pwm0 = NULL;
+
+/* Serializes pwm_config between concurrent writers and the watchdog work */
+static DEFINE_MUTEX(pwm0_lock);
 
 /* duty cycle of PWM
 	** will be passed as an argument to function pwm_config  
 */
 u32 pwm_on_time = 500000;
 
+/* Watchdog: once heartbeats ('h') are received, missing them for wd_timeout_ms raises the boom.
+	** pwm_config may sleep, so the hrtimer only queues high priority work, the safe state is reached
+	** within wd_timeout_ms plus one workqueue wakeup.
+*/
+static unsigned int wd_timeout_ms = 500;
+RAMP_PARAM(pwm, wd_timeout_ms, uint, 0644);
+RAMP_PARAM_DESC(pwm, wd_timeout_ms, "Heartbeat timeout before the boom is raised");
+
+static unsigned int wd_trips;
+RAMP_PARAM(pwm, wd_trips, uint, 0444);
+RAMP_PARAM_DESC(pwm, wd_trips, "Number of watchdog expirations");
+
+static unsigned long wd_last_trip;
+RAMP_PARAM(pwm, wd_last_trip, ulong, 0444);
+RAMP_PARAM_DESC(pwm, wd_last_trip, "Wall clock seconds of the last watchdog expiration");
+
+static struct hrtimer wd_timer;
+static struct work_struct wd_work;
+
+/**
+ * @brief Publishes commanded boom position in the ramp status page
+ */
+static void publish_boom(u8 pos, int wd_trip) {
+	struct ramp_status *st;
+	unsigned long flags;
+
+	st = ramp_status_begin(&flags);
+	st->boom_cmd = pos;
+	st->boom_ns = ktime_get_ns();
+	st->boom_moves++;
+	if(wd_trip)
+		st->pwm_wd_trips++;
+	ramp_status_end(flags);
+}
+
+/**
+ * @brief Moves the boom for ramp_seq, RAMP_BOOM_UP or RAMP_BOOM_DOWN. May sleep.
+ */
+void ramp_boom_set(u8 pos) {
+	char value = pos == RAMP_BOOM_UP ? 'b' : 'e';
+
+	mutex_lock(&pwm0_lock);
+	pwm_config(pwm0, 500000 * (value - 'a'), 20000000);
+	publish_boom(pos == RAMP_BOOM_UP ? RAMP_BOOM_UP : RAMP_BOOM_DOWN, 0);
+	mutex_unlock(&pwm0_lock);
+}
+EXPORT_SYMBOL(ramp_boom_set);
+
+/**
+ * @brief Raises the boom after the watchdog expired
+ */
+static void wd_work_fn(struct work_struct *work) {
+	mutex_lock(&pwm0_lock);
+	pwm_config(pwm0, 500000 * ('b' - 'a'), 20000000);
+	publish_boom(RAMP_BOOM_UP, 1);
+	mutex_unlock(&pwm0_lock);
+	wd_trips++;
+	wd_last_trip = ktime_get_real_seconds();
+	printk("pwm_driver: watchdog expired, boom up\n");
+}
+
+/**
+ * @brief Called by hrtimer when heartbeats stopped
+ */
+static enum hrtimer_restart wd_expired(struct hrtimer *timer) {
+	queue_work(system_highpri_wq, &wd_work);
+	return HRTIMER_NORESTART;
+}
+
 /**
  * @brief Write data to buffer
  */
@@ -38,14 +118,27 @@ static ssize_t driver_write(struct file *File, const char *user_buffer, size_t c
 
 	/* Copy data to user */
 	not_copied = copy_from_user(&value, user_buffer, to_copy);
+	if(to_copy == 0 || not_copied != 0)
+		return -EFAULT;
 
-	printk("%s\n", user_buffer);
+	/* Heartbeat, re-arm the watchdog */
+	if(value == 'h') {
+		hrtimer_start(&wd_timer, ms_to_ktime(wd_timeout_ms), HRTIMER_MODE_REL);
+		return to_copy - not_copied;
+	}
+
+	printk("%c\n", value);
 
 	/* Set PWM on time, check user-space app for message definitions, specific letters used just for easier duty cycle calculation */
-	if(value != 'b' && value != 'e')
+	if(value != 'b' && value != 'e') {
 		printk("Invalid Value\n");
-	else
+	}
+	else {
+		mutex_lock(&pwm0_lock);
 		pwm_config(pwm0, 500000 * (value - 'a'), 20000000);
+		publish_boom(value == 'b' ? RAMP_BOOM_UP : RAMP_BOOM_DOWN, 0);
+		mutex_unlock(&pwm0_lock);
+	}
 
 	/* Calculate data */
 	delta = to_copy - not_copied;
@@ -80,23 +173,42 @@ static struct file_operations fops = {
  * @brief This function is called, when the module is loaded into the kernel
  */
 static int __init ModuleInit(void) {
+	int ret;
+
 	printk("pwm_driver!\n");
 
+	/* Boom up before anything else, the device file only appears once the servo is in the safe state */
+	pwm0 = pwm_request(0, "my-pwm");
+	if(IS_ERR(pwm0)) {
+		printk("Could not get PWM0!\n");
+		return PTR_ERR(pwm0);
+	}
+
+	pwm_config(pwm0, pwm_on_time, 20000000);
+	pwm_enable(pwm0);
+	publish_boom(RAMP_BOOM_UP, 0);
+
+	INIT_WORK(&wd_work, wd_work_fn);
+	hrtimer_init(&wd_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	wd_timer.function = wd_expired;
+
 	/* Allocate a device nr */
-	if( alloc_chrdev_region(&my_device_nr, 0, 1, DRIVER_NAME) < 0) {
+	if((ret = alloc_chrdev_region(&my_device_nr, 0, 1, DRIVER_NAME)) < 0) {
 		printk("pwm_driver Nr. could not be allocated!\n");
-		return -1;
+		goto NrError;
 	}
 	printk("read_write - Device Nr. Major: %d, Minor: %d was registered!\n", my_device_nr >> 20, my_device_nr && 0xfffff);
 
 	/* Create device class */
-	if((my_class = class_create(THIS_MODULE, DRIVER_CLASS)) == NULL) {
+	my_class = ramp_class_get(DRIVER_CLASS);
+	if(IS_ERR(my_class)) {
 		printk("Device class can not be created!\n");
+		ret = PTR_ERR(my_class);
 		goto ClassError;
 	}
 
 	/* create device file */
-	if(device_create(my_class, NULL, my_device_nr, NULL, DRIVER_NAME) == NULL) {
+	if((ret = PTR_ERR_OR_ZERO(device_create(my_class, NULL, my_device_nr, NULL, DRIVER_NAME))) < 0) {
 		printk("Can not create device file!\n");
 		goto FileError;
 	}
@@ -105,42 +217,36 @@ static int __init ModuleInit(void) {
 	cdev_init(&my_device, &fops);
 
 	/* Regisering device to kernel */
-	if(cdev_add(&my_device, my_device_nr, 1) == -1) {
+	if((ret = cdev_add(&my_device, my_device_nr, 1)) < 0) {
 		printk("Registering of device to kernel failed!\n");
 		goto AddError;
 	}
 
-	pwm0 = pwm_request(0, "my-pwm");
-	if(pwm0 == NULL) {
-		printk("Could not get PWM0!\n");
-		goto AddError;
-	}
-
-	pwm_config(pwm0, pwm_on_time, 20000000);
-	pwm_enable(pwm0);
-
 	return 0;
 AddError:
 	device_destroy(my_class, my_device_nr);
 FileError:
-	class_destroy(my_class);
+	ramp_class_put(my_class);
 ClassError:
 	unregister_chrdev_region(my_device_nr, 1);
-	return -1;
+NrError:
+	pwm_free(pwm0);
+	return ret;
 }
 
 /**
  * @brief This function is called, when the module is removed from the kernel
  */
-static void __exit ModuleExit(void) {
+static void RAMP_PART_EXIT ModuleExit(void) {
+	hrtimer_cancel(&wd_timer);
+	cancel_work_sync(&wd_work);
 	pwm_disable(pwm0);
 	pwm_free(pwm0);
 	cdev_del(&my_device);
 	device_destroy(my_class, my_device_nr);
-	class_destroy(my_class);
+	ramp_class_put(my_class);
 	unregister_chrdev_region(my_device_nr, 1);
 	printk("pwm_driver exit\n");
 }
 
-module_init(ModuleInit);
-module_exit(ModuleExit);
\ No newline at end of file
+RAMP_PART(pwm, ModuleInit, ModuleExit)
@@ -0,0 +1,91 @@
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/device.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include "ramp_module.h"
+
+#ifndef RAMP_COMBINED
+#error "ramp_main.c is only built into ramp.ko, together with the drivers compiled with RAMP_COMBINED"
+#endif
+
+/* Meta Information */
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_AUTHOR("PURV Grupa");
+MODULE_DESCRIPTION("All ramp drivers in one module");
+
+/*
+ * Entry point of ramp.ko, built together with all drivers compiled with RAMP_COMBINED.
+ * Parts are started in a fixed order: the status page first since every other part publishes
+ * into it, then the outputs, each of which puts its hardware into the safe state (red light,
+ * boom up, buzzer off) as its first action, the phase sequencer once the outputs it drives exist,
+ * and the sensor last. A failing part unwinds the ones already started.
+ */
+
+#define RAMP_CLASS "ramp"
+
+struct class *ramp_class;
+
+static unsigned int init_us;
+module_param(init_us, uint, 0444);
+MODULE_PARM_DESC(init_us, "Time from module load until all parts were started");
+
+/**
+ * @brief This function is called, when the module is loaded into the kernel
+ */
+static int __init RampInit(void) {
+	ktime_t start = ktime_get();
+	int ret;
+
+	ramp_class = class_create(THIS_MODULE, RAMP_CLASS);
+	if(IS_ERR(ramp_class)) {
+		printk("ramp: device class can not be created!\n");
+		return PTR_ERR(ramp_class);
+	}
+
+	if((ret = ramp_status_init()) < 0)
+		goto StatusError;
+	if((ret = ramp_led_init()) < 0)
+		goto LedError;
+	if((ret = ramp_pwm_init()) < 0)
+		goto PwmError;
+	if((ret = ramp_buzz_init()) < 0)
+		goto BuzzError;
+	if((ret = ramp_seq_init()) < 0)
+		goto SeqError;
+	if((ret = ramp_adc_init()) < 0)
+		goto AdcError;
+
+	init_us = ktime_us_delta(ktime_get(), start);
+	printk(KERN_INFO "ramp: all parts started in %u us\n", init_us);
+	return 0;
+AdcError:
+	ramp_seq_exit();
+SeqError:
+	ramp_buzz_exit();
+BuzzError:
+	ramp_pwm_exit();
+PwmError:
+	ramp_led_exit();
+LedError:
+	ramp_status_exit();
+StatusError:
+	class_destroy(ramp_class);
+	return ret;
+}
+
+/**
+ * @brief This function is called, when the module is removed from the kernel
+ */
+static void __exit RampExit(void) {
+	ramp_adc_exit();
+	ramp_seq_exit();
+	ramp_buzz_exit();
+	ramp_pwm_exit();
+	ramp_led_exit();
+	ramp_status_exit();
+	class_destroy(ramp_class);
+}
+
+module_init(RampInit);
+module_exit(RampExit);
@@ -0,0 +1,72 @@
+#ifndef RAMP_MODULE_H
+#define RAMP_MODULE_H
+
+/*
+ * Glue for building all drivers as one module, ramp.ko. With RAMP_COMBINED defined every driver
+ * becomes a part whose init and exit are called in a fixed order by ramp_main.c, and all device
+ * files share one class. Without it each driver is a module of its own, as before.
+ * ramp_class_get returns an ERR_PTR on failure, like class_create.
+ */
+
+#include <linux/module.h>
+#include <linux/device.h>
+
+#ifdef RAMP_COMBINED
+
+extern struct class *ramp_class;
+
+static inline struct class *ramp_class_get(const char *name)
+{
+    return ramp_class;
+}
+
+static inline void ramp_class_put(struct class *cls)
+{
+}
+
+/* Parameters shared by name between drivers get the part name as prefix, e.g. led_wd_timeout_ms */
+#define RAMP_PARAM(part, name, type, perm) module_param_named(part##_##name, name, type, perm)
+#define RAMP_PARAM_DESC(part, name, desc) MODULE_PARM_DESC(part##_##name, desc)
+
+/* Part exit also unwinds a failed init of ramp.ko, so it cannot be discarded as __exit */
+#define RAMP_PART_EXIT
+#define RAMP_PART(name, init_fn, exit_fn) \
+    int __init ramp_##name##_init(void) { return init_fn(); } \
+    void ramp_##name##_exit(void) { exit_fn(); }
+
+int ramp_status_init(void);
+void ramp_status_exit(void);
+int ramp_led_init(void);
+void ramp_led_exit(void);
+int ramp_pwm_init(void);
+void ramp_pwm_exit(void);
+int ramp_buzz_init(void);
+void ramp_buzz_exit(void);
+int ramp_seq_init(void);
+void ramp_seq_exit(void);
+int ramp_adc_init(void);
+void ramp_adc_exit(void);
+
+#else
+
+static inline struct class *ramp_class_get(const char *name)
+{
+    return class_create(THIS_MODULE, name);
+}
+
+static inline void ramp_class_put(struct class *cls)
+{
+    class_destroy(cls);
+}
+
+#define RAMP_PARAM(part, name, type, perm) module_param(name, type, perm)
+#define RAMP_PARAM_DESC(part, name, desc) MODULE_PARM_DESC(name, desc)
+
+#define RAMP_PART_EXIT __exit
+#define RAMP_PART(name, init_fn, exit_fn) \
+    module_init(init_fn); \
+    module_exit(exit_fn);
+
+#endif
+
+#endif
@@ -0,0 +1,575 @@
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/moduleparam.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include "ramp_status.h"
+#include "ramp_seq.h"
+#include "ramp_module.h"
+
+/* Meta Information */
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_AUTHOR("PURV Grupa");
+MODULE_DESCRIPTION("Phase sequencer running the light and boom program on hrtimers");
+
+/* Variables for device and device class */
+static dev_t my_device_nr;
+static struct class *my_class;
+static struct cdev my_device;
+
+#define DRIVER_NAME "ramp_seq"
+#define DRIVER_CLASS "RampSeqClass"
+
+#define SEQ_CMD_LEN   (1024)    /* Longest command accepted by one write */
+#define SEQ_RING_LEN  (64)      /* Events kept for readers, power of two */
+#define SEQ_MAX_MS    (3600000) /* Longest step */
+
+/* Step boundaries are scheduled in absolute time from the previous one, so timer latency does not
+	** accumulate. A step starting more than late_max_ms after its scheduled time (system stalled, timer
+	** held off) is rebased on the actual start instead of being cut short to catch up.
+*/
+static unsigned int late_max_ms = 100;
+RAMP_PARAM(seq, late_max_ms, uint, 0644);
+RAMP_PARAM_DESC(seq, late_max_ms, "Lateness after which a step is timed from its actual start");
+
+static unsigned int steps;
+RAMP_PARAM(seq, steps, uint, 0444);
+RAMP_PARAM_DESC(seq, steps, "Number of steps entered");
+
+static unsigned int max_late_us;
+RAMP_PARAM(seq, max_late_us, uint, 0444);
+RAMP_PARAM_DESC(seq, max_late_us, "Largest step start lateness seen");
+
+struct seq_step {
+	u32 ms;
+	u8 light;
+	u8 boom;
+};
+
+struct seq_reader {
+	u32 tail;               /* Next event of the ring to return */
+	int initial;            /* STATE event not returned yet */
+};
+
+/* Program and run state, taken from the hrtimer callback as well */
+static DEFINE_SPINLOCK(seq_lock);
+static struct seq_step prog[RAMP_SEQ_MAX_STEPS];
+static int prog_len;
+static struct seq_step staged[RAMP_SEQ_MAX_STEPS];
+static int staged_len;          /* Program applied at the next step boundary, 0 if none */
+static int running;
+static int held;
+static int cur;
+static ktime_t step_end;        /* Scheduled end of the current step */
+static s64 remaining_ns;        /* Time the current step had left when it was held */
+static u32 wd_led, wd_pwm;      /* Watchdog trips seen at start */
+static u8 boom_pending = RAMP_SEQ_BOOM_KEEP;
+
+static struct ramp_seq_event ev_ring[SEQ_RING_LEN];
+static u32 ev_head;
+static DECLARE_WAIT_QUEUE_HEAD(seq_wq);
+
+/* Serializes commands, so start, stop, hold and resume never race each other on the timer */
+static DEFINE_MUTEX(seq_cmd_lock);
+
+static struct hrtimer seq_timer;
+static struct work_struct boom_work;
+
+/**
+ * @brief Fills an event from the current state, seq_lock held
+ */
+static void seq_fill(struct ramp_seq_event *ev, u8 type, u8 reason, s64 late_ns) {
+	memset(ev, 0, sizeof(*ev));
+	ev->t_ns = ktime_get_ns();
+	ev->end_ns = running && !held ? ktime_to_ns(step_end) : 0;
+	ev->seq = ev_head;
+	ev->late_ns = clamp_t(s64, late_ns, S32_MIN, S32_MAX);
+	ev->type = type;
+	ev->step = cur;
+	ev->light = prog_len ? prog[cur].light : RAMP_LIGHT_OFF;
+	ev->boom = prog_len ? prog[cur].boom : RAMP_SEQ_BOOM_KEEP;
+	ev->running = running;
+	ev->held = held;
+	ev->reason = reason;
+}
+
+/**
+ * @brief Queues an event for readers, seq_lock held
+ */
+static void seq_event(u8 type, u8 reason, s64 late_ns) {
+	seq_fill(&ev_ring[ev_head % SEQ_RING_LEN], type, reason, late_ns);
+	ev_head++;
+	wake_up_interruptible(&seq_wq);
+}
+
+/**
+ * @brief Enters step n scheduled to start at start, seq_lock held. The light is set right away,
+ * the boom from high priority work since moving it may sleep.
+ */
+static void seq_enter(int n, ktime_t start, ktime_t now) {
+	s64 late_ns = ktime_to_ns(ktime_sub(now, start));
+
+	cur = n;
+	step_end = ktime_add_ms(start, prog[n].ms);
+	ramp_led_set(prog[n].light);
+	if(prog[n].boom != RAMP_SEQ_BOOM_KEEP) {
+		boom_pending = prog[n].boom;
+		queue_work(system_highpri_wq, &boom_work);
+	}
+	steps++;
+	if(late_ns > 0 && late_ns / 1000 > max_late_us)
+		max_late_us = late_ns / 1000;
+	seq_event(RAMP_SEQ_EV_STEP, 0, late_ns);
+}
+
+/**
+ * @brief Takes the staged program, the current step continues in it by index, seq_lock held
+ */
+static void seq_apply_staged(void) {
+	if(staged_len == 0)
+		return;
+	memcpy(prog, staged, sizeof(prog));
+	prog_len = staged_len;
+	staged_len = 0;
+	cur %= prog_len;
+}
+
+/**
+ * @brief Returns 1 if a led_driver or pwm_driver watchdog expired since start
+ */
+static int seq_wd_tripped(void) {
+	struct ramp_status st;
+
+	ramp_status_copy(&st);
+	return st.led_wd_trips != wd_led || st.pwm_wd_trips != wd_pwm;
+}
+
+/**
+ * @brief Called by hrtimer at the end of a step, enters the next one
+ */
+static enum hrtimer_restart seq_step_end(struct hrtimer *timer) {
+	ktime_t now, start;
+	int next;
+
+	spin_lock(&seq_lock);
+	if(!running || held) {
+		spin_unlock(&seq_lock);
+		return HRTIMER_NORESTART;
+	}
+	/* The watchdog put its output into the safe state, the next step must not undo it */
+	if(seq_wd_tripped()) {
+		running = 0;
+		boom_pending = RAMP_SEQ_BOOM_KEEP;
+		seq_event(RAMP_SEQ_EV_STOP, RAMP_SEQ_BY_WATCHDOG, 0);
+		spin_unlock(&seq_lock);
+		printk("ramp_seq: watchdog expired, stopped\n");
+		return HRTIMER_NORESTART;
+	}
+
+	next = cur + 1;
+	seq_apply_staged();
+	next %= prog_len;
+
+	now = ktime_get();
+	start = step_end;
+	if(ktime_ms_delta(now, start) > late_max_ms)
+		start = now;
+	seq_enter(next, start, now);
+	hrtimer_set_expires(timer, step_end);
+	spin_unlock(&seq_lock);
+	return HRTIMER_RESTART;
+}
+
+/**
+ * @brief Moves the boom for the step just entered
+ */
+static void boom_work_fn(struct work_struct *work) {
+	unsigned long flags;
+	u8 pos;
+
+	spin_lock_irqsave(&seq_lock, flags);
+	pos = boom_pending;
+	boom_pending = RAMP_SEQ_BOOM_KEEP;
+	spin_unlock_irqrestore(&seq_lock, flags);
+	if(pos != RAMP_SEQ_BOOM_KEEP)
+		ramp_boom_set(pos);
+}
+
+/**
+ * @brief Parses one step, e.g. RED:down:5000
+ */
+static int seq_parse_step(char *tok, struct seq_step *step) {
+	char *light = strsep(&tok, ":");
+	char *boom = strsep(&tok, ":");
+
+	if(boom == NULL || tok == NULL || kstrtou32(tok, 10, &step->ms) != 0)
+		return -EINVAL;
+	if(step->ms == 0 || step->ms > SEQ_MAX_MS)
+		return -EINVAL;
+
+	if(strcmp(light, "RED") == 0)
+		step->light = RAMP_LIGHT_RED;
+	else if(strcmp(light, "YELLOW") == 0)
+		step->light = RAMP_LIGHT_YELLOW;
+	else if(strcmp(light, "GREEN") == 0)
+		step->light = RAMP_LIGHT_GREEN;
+	else if(strcmp(light, "OFF") == 0)
+		step->light = RAMP_LIGHT_OFF;
+	else
+		return -EINVAL;
+
+	if(strcmp(boom, "up") == 0)
+		step->boom = RAMP_BOOM_UP;
+	else if(strcmp(boom, "down") == 0)
+		step->boom = RAMP_BOOM_DOWN;
+	else if(strcmp(boom, "-") == 0)
+		step->boom = RAMP_SEQ_BOOM_KEEP;
+	else
+		return -EINVAL;
+	return 0;
+}
+
+/**
+ * @brief Replaces the program, staged until the next step boundary while running
+ */
+static int seq_program(char *args) {
+	struct seq_step *p;
+	unsigned long flags;
+	char *tok;
+	int n = 0, ret = 0;
+
+	p = kcalloc(RAMP_SEQ_MAX_STEPS, sizeof(*p), GFP_KERNEL);
+	if(p == NULL)
+		return -ENOMEM;
+	while((tok = strsep(&args, " ")) != NULL) {
+		if(*tok == '\0')
+			continue;
+		if(n == RAMP_SEQ_MAX_STEPS || (ret = seq_parse_step(tok, &p[n])) < 0) {
+			ret = -EINVAL;
+			goto out;
+		}
+		n++;
+	}
+	if(n == 0) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	spin_lock_irqsave(&seq_lock, flags);
+	if(running) {
+		memcpy(staged, p, sizeof(staged));
+		staged_len = n;
+	}
+	else {
+		memcpy(prog, p, sizeof(prog));
+		prog_len = n;
+		staged_len = 0;
+		cur = 0;
+	}
+	spin_unlock_irqrestore(&seq_lock, flags);
+out:
+	kfree(p);
+	return ret;
+}
+
+/**
+ * @brief Enters step n now and runs the program from there
+ */
+static int seq_start(int n) {
+	struct ramp_status st;
+	unsigned long flags;
+	ktime_t now;
+
+	hrtimer_cancel(&seq_timer);
+	ramp_status_copy(&st);
+
+	spin_lock_irqsave(&seq_lock, flags);
+	seq_apply_staged();
+	if(n < 0 || n >= prog_len) {
+		spin_unlock_irqrestore(&seq_lock, flags);
+		return -EINVAL;
+	}
+	wd_led = st.led_wd_trips;
+	wd_pwm = st.pwm_wd_trips;
+	running = 1;
+	held = 0;
+	now = ktime_get();
+	seq_enter(n, now, now);
+	spin_unlock_irqrestore(&seq_lock, flags);
+
+	hrtimer_start(&seq_timer, step_end, HRTIMER_MODE_ABS);
+	return 0;
+}
+
+/**
+ * @brief Stops the program, outputs stay as they are
+ *
+ * Returns only once a boom move of the current step was dropped or has completed, so a boom command
+ * issued after the stop is never overridden by the sequencer. Process context, may sleep.
+ */
+static void seq_stop(void) {
+	unsigned long flags;
+
+	spin_lock_irqsave(&seq_lock, flags);
+	if(running) {
+		running = 0;
+		held = 0;
+		boom_pending = RAMP_SEQ_BOOM_KEEP;
+		seq_event(RAMP_SEQ_EV_STOP, RAMP_SEQ_BY_USER, 0);
+	}
+	spin_unlock_irqrestore(&seq_lock, flags);
+	hrtimer_cancel(&seq_timer);
+	/* A move already taken by boom_work_fn may still be waiting for the servo */
+	cancel_work_sync(&boom_work);
+}
+
+/**
+ * @brief Freezes the current step with the time it has left
+ */
+static int seq_hold(void) {
+	unsigned long flags;
+
+	spin_lock_irqsave(&seq_lock, flags);
+	if(!running) {
+		spin_unlock_irqrestore(&seq_lock, flags);
+		return -EINVAL;
+	}
+	if(!held) {
+		remaining_ns = max_t(s64, ktime_to_ns(ktime_sub(step_end, ktime_get())), 0);
+		held = 1;
+		seq_event(RAMP_SEQ_EV_HOLD, 0, 0);
+	}
+	spin_unlock_irqrestore(&seq_lock, flags);
+	hrtimer_cancel(&seq_timer);
+	return 0;
+}
+
+/**
+ * @brief Continues a held step for the time it had left
+ */
+static int seq_resume(void) {
+	unsigned long flags;
+
+	spin_lock_irqsave(&seq_lock, flags);
+	if(!running || !held) {
+		spin_unlock_irqrestore(&seq_lock, flags);
+		return running ? 0 : -EINVAL;
+	}
+	held = 0;
+	step_end = ktime_add_ns(ktime_get(), remaining_ns);
+	seq_event(RAMP_SEQ_EV_RESUME, 0, 0);
+	spin_unlock_irqrestore(&seq_lock, flags);
+
+	hrtimer_start(&seq_timer, step_end, HRTIMER_MODE_ABS);
+	return 0;
+}
+
+/**
+ * @brief Executes one command written to the device
+ */
+static ssize_t driver_write(struct file *File, const char *user_buffer, size_t count, loff_t *offs) {
+	char *buf, *cmd, *args;
+	unsigned int n = 0;
+	int ret;
+
+	if(count == 0 || count > SEQ_CMD_LEN)
+		return -EINVAL;
+	buf = memdup_user_nul(user_buffer, count);
+	if(IS_ERR(buf))
+		return PTR_ERR(buf);
+	args = strim(buf);
+	cmd = strsep(&args, " ");
+
+	mutex_lock(&seq_cmd_lock);
+	if(strcmp(cmd, "program") == 0 && args != NULL)
+		ret = seq_program(args);
+	else if(strcmp(cmd, "start") == 0)
+		ret = (args == NULL || kstrtouint(args, 10, &n) == 0) ? seq_start(n) : -EINVAL;
+	else if(strcmp(cmd, "stop") == 0) {
+		seq_stop();
+		ret = 0;
+	}
+	else if(strcmp(cmd, "hold") == 0)
+		ret = seq_hold();
+	else if(strcmp(cmd, "resume") == 0)
+		ret = seq_resume();
+	else
+		ret = -EINVAL;
+	mutex_unlock(&seq_cmd_lock);
+
+	kfree(buf);
+	return ret < 0 ? ret : count;
+}
+
+static int seq_pending(struct seq_reader *reader) {
+	unsigned long flags;
+	int pending;
+
+	spin_lock_irqsave(&seq_lock, flags);
+	pending = reader->initial || reader->tail != ev_head;
+	spin_unlock_irqrestore(&seq_lock, flags);
+	return pending;
+}
+
+/**
+ * @brief Takes the next event, the state first, then changes in order. A reader that fell behind
+ * by more than the ring continues with the oldest event still held.
+ */
+static int seq_next(struct seq_reader *reader, struct ramp_seq_event *ev) {
+	unsigned long flags;
+	int taken = 1;
+
+	spin_lock_irqsave(&seq_lock, flags);
+	if(reader->initial) {
+		reader->initial = 0;
+		seq_fill(ev, RAMP_SEQ_EV_STATE, 0, 0);
+	}
+	else if(reader->tail != ev_head) {
+		if(ev_head - reader->tail > SEQ_RING_LEN)
+			reader->tail = ev_head - SEQ_RING_LEN;
+		*ev = ev_ring[reader->tail % SEQ_RING_LEN];
+		reader->tail++;
+	}
+	else
+		taken = 0;
+	spin_unlock_irqrestore(&seq_lock, flags);
+	return taken;
+}
+
+/**
+ * @brief Returns whole events, blocking until one is available unless the file is non-blocking
+ */
+static ssize_t driver_read(struct file *File, char *user_buffer, size_t count, loff_t *offs) {
+	struct seq_reader *reader = File->private_data;
+	struct ramp_seq_event ev;
+	size_t done = 0;
+
+	if(count < sizeof(ev))
+		return -EINVAL;
+	if(!seq_pending(reader)) {
+		if(File->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if(wait_event_interruptible(seq_wq, seq_pending(reader)))
+			return -ERESTARTSYS;
+	}
+	while(done + sizeof(ev) <= count && seq_next(reader, &ev)) {
+		if(copy_to_user(user_buffer + done, &ev, sizeof(ev)) != 0)
+			return done ? done : -EFAULT;
+		done += sizeof(ev);
+	}
+	return done;
+}
+
+static unsigned int driver_poll(struct file *File, poll_table *wait) {
+	poll_wait(File, &seq_wq, wait);
+	return seq_pending(File->private_data) ? (POLLIN | POLLRDNORM) : 0;
+}
+
+/**
+ * @brief This function is called, when the device file is opened
+ */
+static int driver_open(struct inode *device_file, struct file *instance) {
+	struct seq_reader *reader;
+	unsigned long flags;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if(reader == NULL)
+		return -ENOMEM;
+	spin_lock_irqsave(&seq_lock, flags);
+	reader->tail = ev_head;
+	reader->initial = 1;
+	spin_unlock_irqrestore(&seq_lock, flags);
+	instance->private_data = reader;
+	return 0;
+}
+
+/**
+ * @brief This function is called, when the device file is closed
+ */
+static int driver_close(struct inode *device_file, struct file *instance) {
+	kfree(instance->private_data);
+	return 0;
+}
+
+static struct file_operations fops = {
+	.owner = THIS_MODULE,
+	.open = driver_open,
+	.release = driver_close,
+	.read = driver_read,
+	.write = driver_write,
+	.poll = driver_poll
+};
+
+/**
+ * @brief This function is called, when the module is loaded into the kernel
+ */
+static int __init ModuleInit(void) {
+	int ret;
+
+	printk("ramp_seq!\n");
+
+	INIT_WORK(&boom_work, boom_work_fn);
+	hrtimer_init(&seq_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	seq_timer.function = seq_step_end;
+
+	/* Allocate a device nr */
+	if((ret = alloc_chrdev_region(&my_device_nr, 0, 1, DRIVER_NAME)) < 0) {
+		printk("ramp_seq Nr. could not be allocated!\n");
+		return ret;
+	}
+
+	/* Create device class */
+	my_class = ramp_class_get(DRIVER_CLASS);
+	if(IS_ERR(my_class)) {
+		printk("Device class can not be created!\n");
+		ret = PTR_ERR(my_class);
+		goto ClassError;
+	}
+
+	/* create device file */
+	if((ret = PTR_ERR_OR_ZERO(device_create(my_class, NULL, my_device_nr, NULL, DRIVER_NAME))) < 0) {
+		printk("Can not create device file!\n");
+		goto FileError;
+	}
+
+	/* Initialize device file */
+	cdev_init(&my_device, &fops);
+
+	/* Regisering device to kernel */
+	if((ret = cdev_add(&my_device, my_device_nr, 1)) < 0) {
+		printk("Registering of device to kernel failed!\n");
+		goto AddError;
+	}
+
+	return 0;
+AddError:
+	device_destroy(my_class, my_device_nr);
+FileError:
+	ramp_class_put(my_class);
+ClassError:
+	unregister_chrdev_region(my_device_nr, 1);
+	return ret;
+}
+
+/**
+ * @brief This function is called, when the module is removed from the kernel
+ */
+static void RAMP_PART_EXIT ModuleExit(void) {
+	cdev_del(&my_device);
+	seq_stop();
+	device_destroy(my_class, my_device_nr);
+	ramp_class_put(my_class);
+	unregister_chrdev_region(my_device_nr, 1);
+	printk("ramp_seq exit\n");
+}
+
+RAMP_PART(seq, ModuleInit, ModuleExit)
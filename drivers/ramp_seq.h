@@ -0,0 +1,66 @@
+#ifndef RAMP_SEQ_H
+#define RAMP_SEQ_H
+
+/*
+ * Phase sequencer of ramp_seq.ko. A program of up to RAMP_SEQ_MAX_STEPS steps (light, boom, duration)
+ * is executed on an hrtimer in absolute time, so steps do not drift and do not depend on user-space
+ * scheduling. User-space supervises with text commands written to /dev/ramp_seq, one per write():
+ *
+ *   program RED:down:5000 YELLOW:-:2000 GREEN:up:4000 YELLOW:-:2000
+ *           Lights RED, YELLOW, GREEN or OFF, boom up, down or - (unchanged), duration in ms.
+ *           While running, the new program takes effect at the next step boundary and continues
+ *           with the step that would have come next.
+ *   start [step]    Enters the step (default 0) now and runs the program.
+ *   stop            Stops, lights and boom stay as they are. The write returns once a boom move of
+ *                   the current step was dropped or has completed, so a boom command sent after it
+ *                   is the last one the servo gets.
+ *   hold / resume   Freezes the current step and continues it with the time it had left.
+ *
+ * The sequencer stops on its own when the led_driver or pwm_driver watchdog expires, so the safe
+ * state of the watchdogs is never overridden by the next step.
+ *
+ * read() returns whole struct ramp_seq_event, the first one after open with the current state.
+ * Times are CLOCK_MONOTONIC in nanoseconds. Shared between the kernel module and user-space.
+ */
+
+#include <linux/types.h>
+
+#define RAMP_SEQ_DEVICE        "/dev/ramp_seq"
+#define RAMP_SEQ_MAX_STEPS     (16)
+#define RAMP_SEQ_BOOM_KEEP     (0xFF)  /* Step leaves the boom where it is */
+
+/* Event types */
+#define RAMP_SEQ_EV_STATE      (0)     /* Current state, first event after open */
+#define RAMP_SEQ_EV_STEP       (1)     /* Step entered */
+#define RAMP_SEQ_EV_STOP       (2)     /* Stopped, see reason */
+#define RAMP_SEQ_EV_HOLD       (3)
+#define RAMP_SEQ_EV_RESUME     (4)
+
+/* Stop reasons */
+#define RAMP_SEQ_BY_USER       (0)
+#define RAMP_SEQ_BY_WATCHDOG   (1)
+
+struct ramp_seq_event {
+    __u64 t_ns;             /* Time of the event, actual start for steps */
+    __u64 end_ns;           /* Scheduled end of the step, 0 while stopped or held */
+    __u32 seq;              /* Event counter, a gap means events were lost */
+    __s32 late_ns;          /* Step start after its scheduled time */
+    __u8  type;             /* RAMP_SEQ_EV_* */
+    __u8  step;
+    __u8  light;            /* RAMP_LIGHT_* of the step */
+    __u8  boom;             /* RAMP_BOOM_UP, RAMP_BOOM_DOWN or RAMP_SEQ_BOOM_KEEP */
+    __u8  running;
+    __u8  held;
+    __u8  reason;           /* RAMP_SEQ_BY_* for RAMP_SEQ_EV_STOP */
+    __u8  reserved;
+};
+
+#ifdef __KERNEL__
+
+/* Outputs driven by the sequencer, provided by led_driver and pwm_driver */
+void ramp_led_set(u8 light);            /* Any context */
+void ramp_boom_set(u8 pos);             /* May sleep */
+
+#endif
+
+#endif
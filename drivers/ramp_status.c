@@ -0,0 +1,180 @@
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/uaccess.h>
+#include <linux/mm.h>
+#include <linux/io.h>
+#include <linux/spinlock.h>
+#include <linux/timekeeping.h>
+#include "ramp_status.h"
+#include "ramp_module.h"
+
+/* Meta Information */
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_AUTHOR("PURV Grupa");
+MODULE_DESCRIPTION("Read-only status page with live ramp state");
+
+/* Variables for device and device class */
+static dev_t my_device_nr;
+static struct class *my_class;
+static struct cdev my_device;
+
+#define DRIVER_NAME "ramp_status"
+#define DRIVER_CLASS "RampStatusClass"
+
+/* One zeroed page, written by led, pwm, buzz and adc drivers, mapped read-only by everyone else */
+static unsigned long status_page;
+static struct ramp_status *status;
+
+/* Serializes writers, taken from hrtimer callbacks as well, readers never take it */
+static DEFINE_SPINLOCK(status_lock);
+
+/**
+ * @brief Starts an update, seq becomes odd so readers retry
+ */
+struct ramp_status *ramp_status_begin(unsigned long *flags) {
+	spin_lock_irqsave(&status_lock, *flags);
+	WRITE_ONCE(status->seq, status->seq + 1);
+	smp_wmb();
+	return status;
+}
+EXPORT_SYMBOL(ramp_status_begin);
+
+/**
+ * @brief Ends an update, seq becomes even again
+ */
+void ramp_status_end(unsigned long flags) {
+	smp_wmb();
+	WRITE_ONCE(status->seq, status->seq + 1);
+	spin_unlock_irqrestore(&status_lock, flags);
+}
+EXPORT_SYMBOL(ramp_status_end);
+
+/**
+ * @brief Copies a consistent snapshot of the page, for other parts of the kernel
+ */
+void ramp_status_copy(struct ramp_status *out) {
+	unsigned int seq;
+
+	do {
+		seq = smp_load_acquire(&status->seq);
+		memcpy(out, status, sizeof(*out));
+		smp_rmb();
+	} while((seq & 1) || READ_ONCE(status->seq) != seq);
+}
+EXPORT_SYMBOL(ramp_status_copy);
+
+/**
+ * @brief Returns a consistent copy of the page, for tools that do not map it
+ */
+static ssize_t driver_read(struct file *File, char *user_buffer, size_t count, loff_t *offs) {
+	struct ramp_status snapshot;
+	size_t to_copy;
+
+	if(*offs != 0)
+		return 0;
+	ramp_status_copy(&snapshot);
+
+	to_copy = min(count, sizeof(snapshot));
+	if(copy_to_user(user_buffer, &snapshot, to_copy) != 0)
+		return -EFAULT;
+	*offs += to_copy;
+	return to_copy;
+}
+
+/**
+ * @brief Maps the status page read-only, exactly one page at offset 0
+ */
+static int driver_mmap(struct file *File, struct vm_area_struct *vma) {
+	unsigned long size = vma->vm_end - vma->vm_start;
+
+	if(vma->vm_pgoff != 0 || size != PAGE_SIZE)
+		return -EINVAL;
+	if(vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	return remap_pfn_range(vma, vma->vm_start, virt_to_phys((void *)status_page) >> PAGE_SHIFT, size, vma->vm_page_prot);
+}
+
+static struct file_operations fops = {
+	.owner = THIS_MODULE,
+	.read = driver_read,
+	.mmap = driver_mmap
+};
+
+/**
+ * @brief This function is called, when the module is loaded into the kernel
+ */
+static int __init ModuleInit(void) {
+	int ret;
+
+	printk("ramp_status!\n");
+
+	status_page = get_zeroed_page(GFP_KERNEL);
+	if(status_page == 0)
+		return -ENOMEM;
+	SetPageReserved(virt_to_page((void *)status_page));
+	status = (struct ramp_status *)status_page;
+	status->magic = RAMP_STATUS_MAGIC;
+	status->boom_travel_ms = RAMP_BOOM_TRAVEL_MS;
+	status->load_ns = ktime_get_ns();
+
+	/* Allocate a device nr */
+	if((ret = alloc_chrdev_region(&my_device_nr, 0, 1, DRIVER_NAME)) < 0) {
+		printk("ramp_status Nr. could not be allocated!\n");
+		goto NrError;
+	}
+
+	/* Create device class */
+	my_class = ramp_class_get(DRIVER_CLASS);
+	if(IS_ERR(my_class)) {
+		printk("Device class can not be created!\n");
+		ret = PTR_ERR(my_class);
+		goto ClassError;
+	}
+
+	/* create device file */
+	if((ret = PTR_ERR_OR_ZERO(device_create(my_class, NULL, my_device_nr, NULL, DRIVER_NAME))) < 0) {
+		printk("Can not create device file!\n");
+		goto FileError;
+	}
+
+	/* Initialize device file */
+	cdev_init(&my_device, &fops);
+
+	/* Regisering device to kernel */
+	if((ret = cdev_add(&my_device, my_device_nr, 1)) < 0) {
+		printk("Registering of device to kernel failed!\n");
+		goto AddError;
+	}
+
+	return 0;
+AddError:
+	device_destroy(my_class, my_device_nr);
+FileError:
+	ramp_class_put(my_class);
+ClassError:
+	unregister_chrdev_region(my_device_nr, 1);
+NrError:
+	ClearPageReserved(virt_to_page((void *)status_page));
+	free_page(status_page);
+	return ret;
+}
+
+/**
+ * @brief This function is called, when the module is removed from the kernel
+ */
+static void RAMP_PART_EXIT ModuleExit(void) {
+	cdev_del(&my_device);
+	device_destroy(my_class, my_device_nr);
+	ramp_class_put(my_class);
+	unregister_chrdev_region(my_device_nr, 1);
+	ClearPageReserved(virt_to_page((void *)status_page));
+	free_page(status_page);
+	printk("ramp_status exit\n");
+}
+
+RAMP_PART(status, ModuleInit, ModuleExit)
@@ -0,0 +1,88 @@
+#ifndef RAMP_STATUS_H
+#define RAMP_STATUS_H
+
+/*
+ * Layout of the ramp status page published by ramp_status.ko and mapped read-only by user-space.
+ * Drivers update it under a sequence counter: seq is odd while an update is in progress, readers
+ * copy the page and retry if seq was odd or changed. Times are CLOCK_MONOTONIC in nanoseconds.
+ * Shared between the kernel modules and user-space tools.
+ */
+
+#include <linux/types.h>
+
+#define RAMP_STATUS_MAGIC      (0x31545352)    /* "RST1" */
+#define RAMP_STATUS_DEVICE     "/dev/ramp_status"
+#define RAMP_BOOM_TRAVEL_MS    (1500)          /* Full servo travel, the servo has no position feedback */
+
+/* Lights */
+#define RAMP_LIGHT_OFF         (0)
+#define RAMP_LIGHT_RED         (1)
+#define RAMP_LIGHT_YELLOW      (2)
+#define RAMP_LIGHT_GREEN       (3)
+
+/* Boom positions, commanded position is only DOWN or UP */
+#define RAMP_BOOM_DOWN         (0)
+#define RAMP_BOOM_UP           (1)
+#define RAMP_BOOM_MOVING_DOWN  (2)
+#define RAMP_BOOM_MOVING_UP    (3)
+
+struct ramp_status {
+    __u32 magic;
+    __u32 seq;
+    __u64 light_ns;         /* Time of the last light change */
+    __u64 boom_ns;          /* Time of the last boom command */
+    __u64 buzzer_ns;        /* Time the buzzer was last switched */
+    __u64 sample_ns;        /* Time of the last ADC conversion */
+    __u8  light;            /* RAMP_LIGHT_* */
+    __u8  boom_cmd;         /* Commanded boom position */
+    __u8  buzzer;           /* 1 while buzzing */
+    __u8  sample_flags;     /* adc_driver ADC_FLAG_* of the last conversion */
+    __u16 sample_raw;       /* Last 12-bit sample */
+    __u16 boom_travel_ms;
+    __u32 light_changes;
+    __u32 boom_moves;
+    __u32 buzzes;
+    __u32 conversions;      /* adc_driver conversions */
+    __u32 read_errors;      /* adc_driver failed reads */
+    __u32 led_wd_trips;     /* led_driver watchdog expirations */
+    __u32 pwm_wd_trips;     /* pwm_driver watchdog expirations */
+    __u32 reserved;
+    __u64 load_ns;          /* Time the status page was created, start of ramp.ko init */
+    __u64 first_phase_ns;   /* Time of the first light set by user-space after load */
+};
+
+/* Actual boom position, estimated from the last command and the servo travel time */
+static inline int ramp_status_boom_pos(const struct ramp_status *st, __u64 now_ns)
+{
+    if (now_ns - st->boom_ns >= (__u64)st->boom_travel_ms * 1000000)
+        return st->boom_cmd;
+    return st->boom_cmd == RAMP_BOOM_UP ? RAMP_BOOM_MOVING_UP : RAMP_BOOM_MOVING_DOWN;
+}
+
+#ifdef __KERNEL__
+
+/* Opens an update of the page, the returned pointer may only be used until ramp_status_end */
+struct ramp_status *ramp_status_begin(unsigned long *flags);
+void ramp_status_end(unsigned long flags);
+
+/* Copies a consistent snapshot of the page, must not be called inside an update */
+void ramp_status_copy(struct ramp_status *out);
+
+#else
+
+/* Copies a consistent snapshot of the mapped page */
+static inline void ramp_status_read(const volatile struct ramp_status *page, struct ramp_status *out)
+{
+    __u32 seq;
+
+    do {
+        while ((seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE)) & 1)
+            ;
+        __builtin_memcpy(out, (const void *)page, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) != seq);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+/*
+    Concurrency stress benchmark for adc_driver sample fan-out. For each reader count, that many
+    threads open /dev/adc_driver and read as fast as the driver allows for a fixed time. Reports
+    aggregate and per-reader sample rate together with the number of conversions on the bus.
+    Usage: adc_stress [seconds] [max_readers]
+*/
+
+#define ADC_DRIVER "/dev/adc_driver"
+#define CONVERSIONS "/sys/module/adc_driver/parameters/conversions"
+#define MAX_READERS 64
+
+static volatile int running;
+
+struct reader {
+    pthread_t th;
+    int fd;
+    unsigned long samples;
+    unsigned long errors;
+};
+
+static void* reader_fun(void* param){
+    struct reader* r = param;
+    char data[2];
+
+    while(running){
+        if(read(r->fd, data, 2) == 2)
+            r->samples++;
+        else
+            r->errors++;
+    }
+    return NULL;
+}
+
+static long read_conversions(void){
+    FILE* f = fopen(CONVERSIONS, "r");
+    long n = -1;
+
+    if(f != NULL){
+        if(fscanf(f, "%ld", &n) != 1)
+            n = -1;
+        fclose(f);
+    }
+    return n;
+}
+
+int main(int argc, char* argv[])
+{
+    static struct reader readers[MAX_READERS];
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    int max_readers = argc > 2 ? atoi(argv[2]) : 16;
+    unsigned long total, errors;
+    long conv_start, conv_end;
+    int n, i;
+
+    if(max_readers > MAX_READERS)
+        max_readers = MAX_READERS;
+
+    printf("%8s %14s %16s %14s %8s\n", "readers", "samples/s", "per reader/s", "conversions/s", "errors");
+    for(n = 1; n <= max_readers; n *= 2){
+        for(i = 0; i < n; i++){
+            readers[i].samples = 0;
+            readers[i].errors = 0;
+            readers[i].fd = open(ADC_DRIVER, O_RDWR);
+            if(readers[i].fd < 0){
+                perror("Failed opening " ADC_DRIVER);
+                return -1;
+            }
+        }
+
+        running = 1;
+        conv_start = read_conversions();
+        for(i = 0; i < n; i++)
+            pthread_create(&readers[i].th, NULL, reader_fun, &readers[i]);
+        sleep(seconds);
+        running = 0;
+        total = 0;
+        errors = 0;
+        for(i = 0; i < n; i++){
+            pthread_join(readers[i].th, NULL);
+            close(readers[i].fd);
+            total += readers[i].samples;
+            errors += readers[i].errors;
+        }
+        conv_end = read_conversions();
+
+        printf("%8d %14.1f %16.1f %14.1f %8lu\n", n, (double)total / seconds, (double)total / seconds / n,
+               conv_start >= 0 && conv_end >= 0 ? (double)(conv_end - conv_start) / seconds : -1.0, errors);
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "gpio_window.h"
+
+/*
+    Compares light updates through led_driver write() with stores through the mmap'd GPIO window.
+    Usage: gpio_bench [iterations]
+*/
+
+#define BUF_LEN 10
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[])
+{
+    static const uint32_t masks[3] = { 1u << GPIO_LED_RED, 1u << GPIO_LED_YELLOW, 1u << GPIO_LED_GREEN };
+    char buf[3][BUF_LEN] = { "RED", "YELLOW", "GREEN" };
+    struct gpio_window w;
+    long iterations = argc > 1 ? atol(argv[1]) : 100000;
+    volatile uint32_t sink = 0;
+    double start, write_ns, store_ns, load_ns;
+    long i;
+    int fd;
+
+    fd = open("/dev/led_driver", O_RDWR);
+    if(fd < 0){
+        perror("Failed opening /dev/led_driver");
+        return -1;
+    }
+    if(gpio_window_open(&w, fd) < 0){
+        perror("Failed mapping GPIO window (needs CAP_SYS_RAWIO)");
+        return -1;
+    }
+
+    start = now_ns();
+    for(i = 0; i < iterations; i++)
+        write(fd, buf[i % 3], BUF_LEN);
+    write_ns = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for(i = 0; i < iterations; i++)
+        gpio_window_lights(&w, masks[i % 3]);
+    store_ns = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for(i = 0; i < iterations; i++)
+        sink += gpio_window_levels(&w);
+    load_ns = (now_ns() - start) / iterations;
+
+    printf("iterations         %ld\n", iterations);
+    printf("write()            %.1f ns/update\n", write_ns);
+    printf("mmap store         %.1f ns/update (%.1fx)\n", store_ns, write_ns / store_ns);
+    printf("mmap level load    %.1f ns/read\n", load_ns);
+
+    gpio_window_lights(&w, 0);
+    gpio_window_close(&w);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pair.h"
+
+/*
+    Checks the passage protocol of pair.h: ramps and the scheduler run as separate actors whose shared memory
+    accesses interleave in random order, and no two ramps may ever be open on the grant at once. A ramp takes
+    the grant like pair_may_open does (report open, read the grant, report closed again if it is not its own),
+    the scheduler like tools/ramp_pair.c does (read every report, decide, publish the grant). Exits with 1 and
+    prints the interleaving step at the first violation.
+    Usage: pair_check [runs] [steps] [ramps]
+*/
+
+#define CHECK_PERIOD_US (PAIR_PERIOD_MS * 1000ULL)
+#define CHECK_CLEAR_US (2 * CHECK_PERIOD_US)   /* Short clearance, so grants move often */
+#define CHECK_MAX_OPEN_STEPS 40
+
+enum ramp_state { RAMP_CLOSED, RAMP_REPORTED, RAMP_OPEN };
+
+struct ramp {
+    enum ramp_state state;
+    int want;                   /* Vehicles waiting or a priority open, reported as demand */
+    int open_steps;             /* Steps left before an open ramp closes */
+};
+
+/* Shared memory of the model, accessed one field per step */
+static int sh_open[PAIR_LANES];
+static int sh_demand[PAIR_LANES];
+static int sh_grant;
+
+/* One step of ramp i, returns -1 or a ramp that is open at the same time as i */
+static int ramp_step(struct ramp* ramps, int i, int lanes){
+    struct ramp* r = &ramps[i];
+    int j;
+
+    switch(r->state){
+        case RAMP_CLOSED:
+            if(!r->want){
+                r->want = rand() % 4 != 0 ? 0 : rand() % 8 == 0 ? PAIR_DEMAND_PRIORITY : 1;
+                sh_demand[i] = r->want;
+            }
+            else if(rand() % 2 == 0){
+                sh_open[i] = 1;
+                r->state = RAMP_REPORTED;
+            }
+            break;
+        case RAMP_REPORTED:
+            if(sh_grant != i){
+                sh_open[i] = 0;
+                r->state = RAMP_CLOSED;
+                break;
+            }
+            r->state = RAMP_OPEN;
+            r->want = 0;
+            r->open_steps = 1 + rand() % CHECK_MAX_OPEN_STEPS;
+            break;
+        case RAMP_OPEN:
+            if(--r->open_steps == 0){
+                sh_open[i] = 0;
+                sh_demand[i] = 0;
+                r->state = RAMP_CLOSED;
+            }
+            break;
+    }
+    if(r->state == RAMP_OPEN)
+        for(j = 0; j < lanes; j++)
+            if(j != i && ramps[j].state == RAMP_OPEN)
+                return j;
+    return -1;
+}
+
+int main(int argc, char* argv[])
+{
+    long runs = argc > 1 ? atol(argv[1]) : 2000;
+    long steps = argc > 2 ? atol(argv[2]) : 20000;
+    int lanes = argc > 3 ? atoi(argv[3]) : 2;
+    struct ramp ramps[PAIR_LANES];
+    struct pair_sched ps;
+    int open[PAIR_LANES], demand[PAIR_LANES];
+    unsigned long switches = 0;
+    uint64_t now;
+    long run, step;
+    int read_next, actor, other;
+
+    if(lanes < 2 || lanes > PAIR_LANES){
+        fprintf(stderr, "Usage: %s [runs] [steps] [ramps 2..%d]\n", argv[0], PAIR_LANES);
+        return -1;
+    }
+    for(run = 0; run < runs; run++){
+        srand(run + 1);
+        memset(ramps, 0, sizeof(ramps));
+        memset(sh_open, 0, sizeof(sh_open));
+        memset(sh_demand, 0, sizeof(sh_demand));
+        sh_grant = -1;
+        now = CHECK_PERIOD_US;
+        pair_sched_init(&ps, lanes, CHECK_CLEAR_US, rand() % 2 ? PAIR_ADAPTIVE : PAIR_FIXED);
+        read_next = 0;
+
+        for(step = 0; step < steps; step++){
+            actor = rand() % (lanes + 1);
+            if(actor < lanes){
+                if((other = ramp_step(ramps, actor, lanes)) >= 0){
+                    printf("Run %ld step %ld: ramps %d and %d open at once\n", run, step, actor, other);
+                    return 1;
+                }
+                continue;
+            }
+            /* Scheduler reads one report per step, decides and publishes after the last one */
+            if(read_next < lanes){
+                open[read_next] = sh_open[read_next];
+                demand[read_next] = sh_demand[read_next];
+                read_next++;
+                continue;
+            }
+            sh_grant = pair_decide(&ps, now, open, demand);
+            now += CHECK_PERIOD_US;
+            read_next = 0;
+        }
+        switches += ps.switches;
+    }
+    printf("%ld runs of %ld steps with %d ramps, %lu grants, never two ramps open\n", runs, steps, lanes, switches);
+    return 0;
+}
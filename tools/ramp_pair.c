@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "pair.h"
+
+/*
+    Passage scheduler of a group of ramps sharing one single lane. Reads the reports ramps started with
+    -P <lane> publish, decides every PAIR_PERIOD_MS which ramp may open and publishes the grant. A ramp that
+    stopped reporting keeps the passage blocked while its last report was open, its demand is ignored.
+    Usage: ramp_pair [-n ramps] [-c clearance_ms] [-f] [-s shm_name]
+*/
+
+static uint64_t mono_us(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char* argv[])
+{
+    struct timespec period = { 0, PAIR_PERIOD_MS * 1000000L };
+    const char* name = PAIR_SHM;
+    enum pair_policy policy = PAIR_ADAPTIVE;
+    struct pair_sched ps;
+    struct pair pair;
+    int open[PAIR_LANES], demand[PAIR_LANES];
+    int lanes = 2;
+    int clear_ms = PAIR_CLEAR_MS;
+    int grant, last_grant = -2;
+    uint64_t now;
+    int opt, i;
+
+    while((opt = getopt(argc, argv, "n:c:fs:")) != -1){
+        switch(opt){
+            case 'n': lanes = atoi(optarg); break;
+            case 'c': clear_ms = atoi(optarg); break;
+            case 'f': policy = PAIR_FIXED; break;
+            case 's': name = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n ramps] [-c clearance_ms] [-f] [-s shm_name]\n", argv[0]);
+                return -1;
+        }
+    }
+    if(lanes < 2 || lanes > PAIR_LANES || clear_ms < 0){
+        fprintf(stderr, "Usage: %s [-n ramps] [-c clearance_ms] [-f] [-s shm_name]\n", argv[0]);
+        return -1;
+    }
+    if(pair_open(&pair, name, 1, lanes) < 0){
+        perror("FATAL ERROR: Failed opening group shared memory !!\n");
+        return -1;
+    }
+    pair_sched_init(&ps, lanes, (uint64_t)clear_ms * 1000, policy);
+
+    /* Ramps may be open already, nothing is granted until all were seen closed for the clearance */
+    now = mono_us();
+    for(i = 0; i < lanes; i++)
+        ps.open_us[i] = now;
+    printf("Group %s, %d ramps, %d ms clearance, %s\n", name, lanes, clear_ms, policy == PAIR_FIXED ? "fixed" : "adaptive");
+    fflush(stdout);
+
+    while(1){
+        now = mono_us();
+        for(i = 0; i < lanes; i++){
+            open[i] = atomic_load(&pair.shm->lane[i].open);
+            demand[i] = now - atomic_load_explicit(&pair.shm->lane[i].seen_us, memory_order_relaxed) < PAIR_STALE_MS * 1000ULL ?
+                        atomic_load_explicit(&pair.shm->lane[i].demand, memory_order_relaxed) : 0;
+        }
+        /* Published before the next reports are read, a withdrawn grant is given again only on those */
+        grant = pair_decide(&ps, now, open, demand);
+        atomic_store(&pair.shm->grant, grant);
+        atomic_store_explicit(&pair.shm->green_ms, ps.green_ms, memory_order_relaxed);
+        atomic_store_explicit(&pair.shm->switches, ps.switches, memory_order_relaxed);
+        atomic_store_explicit(&pair.shm->alive_us, now, memory_order_relaxed);
+
+        if(grant != last_grant){
+            if(grant >= 0)
+                printf("ramp %d granted%s\n", grant, demand[grant] == PAIR_DEMAND_PRIORITY ? ", priority open" :
+                                                      demand[grant] ? ", vehicles waiting" : "");
+            else
+                printf("all red, ramp %d next\n", ps.next);
+            fflush(stdout);
+            last_grant = grant;
+        }
+        nanosleep(&period, NULL);
+    }
+    return 0;
+}
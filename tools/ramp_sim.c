@@ -0,0 +1,636 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <math.h>
+#include "ramp.h"
+#include "passage.h"
+#include "pair.h"
+#include "baseline.h"
+#include "predict.h"
+#include "cycle.h"
+
+/*
+    Discrete-event simulator of many ramps. Every ramp runs the phase cycle and the detection
+    rules of ramp_app from cycle.c (cycle RED, YELLOW, GREEN, YELLOW, boom raise and hold on a sample within the
+    threshold, early end of the hold once the lane stays clear, restart from RED after the hold) on its own
+    virtual clock in ms. Cycle, sensor levels and timing constants come from ramp.h, and the samples go through the same
+    passage detector, ambient baseline and, with -A, approach predictor as in ramp_app. Sampling goes on
+    during detection holds like in sensor_controller_fun. Vehicles arrive by a Poisson process or from a
+    recorded arrival list, queue in front of the boom, drive through on GREEN and produce a modeled distance
+    that is sampled at the adaptive ADC rate.
+    Ramps are spread over all cores, results are reported per timing policy.
+    With -g, ramps form groups sharing one single-lane passage and results are reported per coordination:
+    none (independent cycles, as without ramp_pair), fixed turns and adaptive, both with -c ms of all-red
+    clearance. Conflicts count the times two ramps of a group were open at once.
+    With -L, an induction loop under the boom is occupied while a vehicle is under it, as INPUT_LOOP of
+    ramp_app. With -F, the operator sends force-close at random times, followed by resume. Each request goes
+    through the check of the "force-close" command. The ramp_app check is reported, and requests accepted while
+    the loop was occupied must stay at zero.
+
+    Usage: ramp_sim [-n ramps] [-H hours] [-l vehicles_per_hour] [-a arrivals_file] [-s spike_rate] [-j threads] [-P policy]
+                    [-R clear_debounce_ms] [-A] [-g group_size [-c clearance_ms]] [-L] [-F force_closes_per_hour]
+    Arrival file holds one arrival time in seconds per line, every ramp replays it from a random offset.
+*/
+
+#define BOOM_TRAVEL_MS (BOOM_TRAVEL_US / 1000)
+#define ACTIVE_PERIOD_MS 2     /* adc_driver active_period_us */
+#define IDLE_PERIOD_MS 100     /* adc_driver idle_period_us */
+
+/* Vehicle and IR sensor model, distances after calibration */
+#define IR_FLOOR_MM 450        /* Empty lane */
+#define IR_VEHICLE_MM 90       /* Vehicle under the boom */
+#define IR_NOISE_MM 8          /* Uniform noise of a sample, plus or minus */
+#define APPROACH_MS 1000       /* Stop line to sensor zone */
+#define UNDER_MIN_MS 600       /* Shortest time a vehicle spends under the boom */
+#define UNDER_MAX_MS 2400
+#define HEADWAY_MS 1500        /* Least time between one vehicle leaving and the next one starting */
+
+#define MAX_THREADS 256
+#define NO_EVENT UINT64_MAX
+
+/* Timing policy under test */
+struct policy {
+    const char* name;
+    uint32_t phase_ms[PHASE_COUNT]; /* Duration of each phase */
+    uint32_t hold_ms;               /* Detection hold, RED_SLEEP in main.c */
+};
+
+static const struct policy policies[] = {
+    { "fixed",       { 5000, 2000, 4000 }, 5000 }, /* Current ramp_app timing */
+    { "long-green",  { 5000, 2000, 8000 }, 5000 },
+    { "short-cycle", { 3000, 1000, 3000 }, 3000 },
+};
+#define POLICY_COUNT (int)(sizeof(policies) / sizeof(policies[0]))
+
+/* Results of one or more ramps */
+struct sim_result {
+    uint64_t arrived;
+    uint64_t passed;
+    uint64_t detected;        /* Vehicles confirmed by the passage detector */
+    uint64_t detections;      /* Samples within the threshold outside a hold, each raises the boom */
+    uint64_t false_stops;     /* Detections without a vehicle in the sensor zone */
+    uint64_t unsafe;          /* Boom lowered while a vehicle was in the sensor zone */
+    uint64_t conflicts;       /* Two ramps of a group open at once */
+    uint64_t early_releases;  /* Detection holds ended early because the lane was clear */
+    uint64_t forced;          /* Operator force-close requests accepted */
+    uint64_t refused;         /* Operator force-close requests refused with "ERR obstacle" */
+    uint64_t forced_on_loop;  /* Force-close accepted while the loop was occupied */
+    uint64_t samples;
+    double queue_ms;          /* Integral of queue length over time */
+    uint32_t max_queue;
+};
+
+/* Simulation parameters shared by all workers */
+struct sim_cfg {
+    int ramps;
+    uint64_t end_ms;
+    double rate_per_ms;       /* Poisson arrival rate */
+    double* arrivals;         /* Recorded arrivals in ms, used instead of Poisson if not NULL */
+    size_t arrival_count;
+    double spike_rate;        /* Probability of a single noisy sample within the threshold */
+    const struct policy* pol;
+    int group;                /* Ramps sharing one passage */
+    int coord;                /* enum pair_policy, -1 without coordination */
+    uint64_t clear_ms;
+    int debounce_ms;          /* clear_debounce_ms of main.c, 0 keeps the full hold */
+    int predict;              /* Approach predictor in use, -a of main.c */
+    int loop;                 /* Induction loop modeled */
+    double force_per_ms;      /* Rate of operator force-close requests, 0 for none */
+};
+
+static const char* coord_name[] = { "pair-fixed", "pair-adaptive" };
+
+struct ramp {
+    uint64_t rng;
+    uint64_t t;
+    struct cycle cyc;         /* Cycle and detection state on the clock t * 1000 us */
+    int lane;                 /* Index in the group */
+    const struct sim_cfg* cfg;
+    const struct pair_sched* ps;
+    struct sim_result* res;
+    int phase;
+    uint64_t phase_since;
+    int lights_off;           /* Lights switched off by a detection until next phase */
+    uint64_t next_sample;
+    uint64_t next_force;      /* Next operator force-close request */
+    struct passage_detector pd;
+    struct baseline amb;
+    struct predictor pred;
+    unsigned threshold_mm;
+
+    uint32_t queue;
+    uint64_t next_arrival;
+    size_t arrival_idx;
+    uint64_t arrival_base;
+
+    int veh_active;           /* Vehicle approaching or under the boom */
+    uint64_t veh_start;
+    uint64_t veh_under;
+    uint64_t veh_exit;
+    uint64_t last_exit;
+};
+
+static uint64_t rng_next(uint64_t* s){
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform in (0, 1] */
+static double rng_unit(uint64_t* s){
+    return ((rng_next(s) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static void schedule_arrival(struct ramp* r, const struct sim_cfg* cfg){
+    double span;
+
+    if(cfg->arrivals == NULL){
+        r->next_arrival = r->t + (uint64_t)(-log(rng_unit(&r->rng)) / cfg->rate_per_ms) + 1;
+        return;
+    }
+    /* Recorded arrivals repeat after the last one, each ramp starts at its own offset */
+    span = cfg->arrivals[cfg->arrival_count - 1] + 1;
+    if(++r->arrival_idx >= cfg->arrival_count){
+        r->arrival_idx = 0;
+        r->arrival_base += (uint64_t)span;
+    }
+    r->next_arrival = r->arrival_base + (uint64_t)cfg->arrivals[r->arrival_idx];
+}
+
+/* Vehicle is in the sensor zone, close enough to be hit by a lowering boom */
+static int vehicle_in_zone(const struct ramp* r){
+    return r->veh_active && r->t + BOOM_TRAVEL_MS / 3 >= r->veh_under && r->t < r->veh_exit;
+}
+
+/* Distance measured at current time, calib_mm of the sample adc_driver would return */
+static unsigned ir_sample(struct ramp* r, const struct sim_cfg* cfg){
+    int noise = (int)(rng_next(&r->rng) % (2 * IR_NOISE_MM + 1)) - IR_NOISE_MM;
+
+    if(cfg->spike_rate > 0 && rng_unit(&r->rng) < cfg->spike_rate)
+        return IR_VEHICLE_MM;
+    if(r->veh_active && r->t >= r->veh_start && r->t < r->veh_exit){
+        if(r->t >= r->veh_under)
+            return IR_VEHICLE_MM + noise;
+        return IR_FLOOR_MM - (int)((IR_FLOOR_MM - IR_VEHICLE_MM) * (r->t - r->veh_start) / APPROACH_MS) / 2 + noise;
+    }
+    return IR_FLOOR_MM + noise;
+}
+
+static void move_boom(struct ramp* r, int up){
+    if(!up && r->cyc.boom_up && vehicle_in_zone(r))
+        r->res->unsafe++;
+    cycle_boom_moved(&r->cyc, up);
+}
+
+/* Time of the last boom move command in ms */
+static uint64_t boom_moved(const struct ramp* r){
+    return r->cyc.boom_moved_us / 1000;
+}
+
+/* Next cycle deadline in ms */
+static uint64_t ramp_due(const struct ramp* r){
+    return (r->cyc.deadline_us + 999) / 1000;
+}
+
+static uint64_t sim_now(void* ctx){
+    return ((struct ramp*)ctx)->t * 1000;
+}
+
+/* apply_phase() of main.c, entering a step never fails here */
+static int apply_phase(void* ctx, int step){
+    struct ramp* r = ctx;
+    int phase = cycle_phase[step];
+
+    r->phase = phase;
+    r->phase_since = r->t;
+    r->lights_off = 0;
+    if(phase == PHASE_RED)
+        move_boom(r, 0);
+    else if(phase == PHASE_GREEN)
+        move_boom(r, 1);
+    return 0;
+}
+
+/* obstacle_detected() of main.c */
+static void obstacle_detected(void* ctx, uint64_t t_us){
+    struct ramp* r = ctx;
+
+    r->res->detections++;
+    if(!vehicle_in_zone(r))
+        r->res->false_stops++;
+    move_boom(r, 1);
+    r->lights_off = 1;
+}
+
+/* lowering_reversed() of main.c */
+static void lowering_reversed(void* ctx){
+    move_boom(ctx, 1);
+}
+
+static int ramp_demand(const struct ramp* r){
+    return r->queue > 0 || r->veh_active;
+}
+
+/*
+    step_wait() of main.c. In a coordinated group the ramp leaves RED only with the grant, and a ramp with
+    demand keeps GREEN up to the length the scheduler allows, both re-checked every PAIR_RECHECK_MS.
+*/
+static uint64_t step_wait(void* ctx, int step){
+    struct ramp* r = ctx;
+
+    if(r->cfg->coord < 0 || r->cyc.flag)
+        return 0;
+    if((step == 0 && r->ps->grant != r->lane) ||
+       (r->phase == PHASE_GREEN && ramp_demand(r) && r->t - r->phase_since + PAIR_RECHECK_MS <= r->ps->green_ms))
+        return PAIR_RECHECK_MS * 1000ULL;
+    return 0;
+}
+
+/* A hold that ended early resumes the cycle at once, the main loop of ramp_app does it on its next pass */
+static void cycle_notify(void* ctx, enum cycle_event ev, uint64_t arg){
+    struct ramp* r = ctx;
+
+    if(ev == CYCLE_EV_RELEASED){
+        r->res->early_releases++;
+        cycle_resume(&r->cyc);
+    }
+}
+
+static const struct cycle_ops sim_hooks = {
+    .now = sim_now,
+    .enter = apply_phase,
+    .detected = obstacle_detected,
+    .reverse = lowering_reversed,
+    .wait = step_wait,
+    .event = cycle_notify
+};
+
+/* One iteration of sensor_controller_fun(), sensor_process() of main.c */
+static void sensor_step(struct ramp* r){
+    const struct sim_cfg* cfg = r->cfg;
+    struct sim_result* res = r->res;
+    struct passage_event ev;
+    unsigned mm = ir_sample(r, cfg);
+    int occupied, idle;
+
+    res->samples++;
+    r->threshold_mm = baseline_feed(&r->amb, r->t * 1000, mm, r->pd.state == PD_IDLE && !cycle_approaching(&r->cyc));
+    r->pred.threshold_mm = r->threshold_mm;
+    occupied = mm <= r->threshold_mm;
+    if(passage_feed(&r->pd, occupied, r->t, &ev) && ev.type == PASSAGE_ENTER)
+        res->detected++;
+    if(cfg->predict && predict_feed(&r->pred, r->t * 1000, mm))
+        cycle_approach(&r->cyc);
+    idle = mm > SENSOR_NEAR_MM && !r->cyc.boom_up && r->t - boom_moved(r) > BOOM_TRAVEL_MS && r->pd.state == PD_IDLE;
+    r->next_sample = r->t + (idle ? IDLE_PERIOD_MS : ACTIVE_PERIOD_MS);
+    cycle_sample(&r->cyc, r->t * 1000, mm, r->threshold_mm);
+}
+
+/* Next time the vehicle model changes state, starting a queued vehicle if the lane is open */
+static uint64_t vehicle_next(struct ramp* r, struct sim_result* res){
+    uint64_t start;
+
+    if(r->veh_active){
+        if(r->t >= r->veh_exit){
+            r->veh_active = 0;
+            r->last_exit = r->t;
+            res->passed++;
+        }
+        else
+            return r->t < r->veh_under ? r->veh_under : r->veh_exit;
+    }
+    if(r->queue == 0 || r->phase != PHASE_GREEN || r->lights_off || !r->cyc.boom_up)
+        return NO_EVENT;
+    start = boom_moved(r) + BOOM_TRAVEL_MS;
+    if(r->last_exit + HEADWAY_MS > start)
+        start = r->last_exit + HEADWAY_MS;
+    if(start > r->t)
+        return start;
+
+    r->queue--;
+    r->veh_active = 1;
+    r->veh_start = r->t;
+    r->veh_under = r->t + APPROACH_MS;
+    r->veh_exit = r->veh_under + UNDER_MIN_MS + rng_next(&r->rng) % (UNDER_MAX_MS - UNDER_MIN_MS);
+    return r->veh_under;
+}
+
+static uint64_t min_u64(uint64_t a, uint64_t b){
+    return a < b ? a : b;
+}
+
+/* Ramp is not at RED or its boom is up, as reported to the pair scheduler; the clearance covers the lowering */
+static int ramp_open(const struct ramp* r){
+    return r->phase != PHASE_RED || r->cyc.boom_up;
+}
+
+/* inputs_handle() of main.c for the loop under the boom, occupied while a vehicle is under it */
+static void loop_update(struct ramp* r){
+    int occupied = r->cfg->loop && r->veh_active && r->t >= r->veh_under && r->t < r->veh_exit;
+
+    if(occupied == r->cyc.loop_occupied)
+        return;
+    r->cyc.loop_occupied = occupied;
+    if(occupied)
+        cycle_reverse(&r->cyc);
+}
+
+/* "force-close" and "resume" of exec_command() in main.c, the cycle restarts from RED when accepted */
+static void force_close(struct ramp* r){
+    r->next_force = r->t + (uint64_t)(-log(rng_unit(&r->rng)) / r->cfg->force_per_ms) + 1;
+    if(!cycle_may_close(&r->cyc)){
+        r->res->refused++;
+        return;
+    }
+    r->res->forced++;
+    if(r->cyc.loop_occupied)
+        r->res->forced_on_loop++;
+    cycle_enter(&r->cyc, 0);
+}
+
+static void ramp_init(struct ramp* r, int idx, int lane, const struct sim_cfg* cfg, const struct pair_sched* ps,
+                      struct sim_result* res){
+    struct passage_cfg pcfg = { PASSAGE_MIN_DWELL_MS, PASSAGE_MIN_GAP_MS };
+    int i;
+
+    memset(r, 0, sizeof(*r));
+    r->rng = 0x9E3779B97F4A7C15ULL * (idx + 1);
+    passage_init(&r->pd, &pcfg);
+    baseline_init(&r->amb, SENSOR_THRESHOLD_MM);
+    predict_init(&r->pred, SENSOR_THRESHOLD_MM, SENSOR_NEAR_MM);
+    r->threshold_mm = SENSOR_THRESHOLD_MM;
+    if(cfg->arrivals != NULL){
+        r->arrival_idx = rng_next(&r->rng) % cfg->arrival_count;
+        r->arrival_base = 0;
+        r->next_arrival = (uint64_t)cfg->arrivals[r->arrival_idx];
+    }
+    else
+        schedule_arrival(r, cfg);
+    r->next_force = cfg->force_per_ms > 0 ? (uint64_t)(-log(rng_unit(&r->rng)) / cfg->force_per_ms) + 1 : NO_EVENT;
+    r->lane = lane;
+    r->cfg = cfg;
+    r->ps = ps;
+    r->res = res;
+    cycle_init(&r->cyc, &sim_hooks, r);
+    for(i = 0; i < PHASE_COUNT; i++)
+        r->cyc.phase_us[i] = cfg->pol->phase_ms[i] * 1000ULL;
+    r->cyc.hold_us = cfg->pol->hold_ms * 1000ULL;
+    r->cyc.debounce_us = cfg->debounce_ms * 1000ULL;
+    cycle_enter(&r->cyc, 0);
+}
+
+static void run_group(int idx, const struct sim_cfg* cfg, struct sim_result* res){
+    struct ramp r[PAIR_LANES];
+    uint64_t veh[PAIR_LANES];
+    int open[PAIR_LANES], demand[PAIR_LANES];
+    struct pair_sched ps;
+    uint64_t t = 0, next, coord_next = 0;
+    int n = cfg->group;
+    int conflict = 0;
+    int i, count;
+
+    pair_sched_init(&ps, n, cfg->clear_ms * 1000, cfg->coord >= 0 ? cfg->coord : PAIR_FIXED);
+    for(i = 0; i < n; i++){
+        ramp_init(&r[i], idx * n + i, i, cfg, &ps, res);
+        veh[i] = vehicle_next(&r[i], res);
+    }
+
+    while(t < cfg->end_ms){
+        next = cfg->coord >= 0 ? coord_next : NO_EVENT;
+        for(i = 0; i < n; i++)
+            next = min_u64(next, min_u64(min_u64(min_u64(r[i].next_sample, ramp_due(&r[i])), min_u64(r[i].next_arrival, veh[i])),
+                                         r[i].next_force));
+        if(next > cfg->end_ms)
+            next = cfg->end_ms;
+        for(i = 0; i < n; i++){
+            res->queue_ms += (double)r[i].queue * (next - t);
+            r[i].t = next;
+        }
+        t = next;
+
+        if(cfg->coord >= 0 && t >= coord_next){
+            for(i = 0; i < n; i++){
+                open[i] = ramp_open(&r[i]);
+                demand[i] = ramp_demand(&r[i]);
+            }
+            pair_decide(&ps, t * 1000, open, demand);
+            coord_next = t + PAIR_PERIOD_MS;
+        }
+        for(i = 0; i < n; i++){
+            if(t >= r[i].next_arrival){
+                r[i].queue++;
+                res->arrived++;
+                if(r[i].queue > res->max_queue)
+                    res->max_queue = r[i].queue;
+                schedule_arrival(&r[i], cfg);
+            }
+            if(t >= ramp_due(&r[i]))
+                cycle_advance(&r[i].cyc);
+            if(t >= r[i].next_force)
+                force_close(&r[i]);
+            if(t >= r[i].next_sample)
+                sensor_step(&r[i]);
+            veh[i] = vehicle_next(&r[i], res);
+            loop_update(&r[i]);
+        }
+
+        if(n > 1){
+            for(i = 0, count = 0; i < n; i++)
+                count += ramp_open(&r[i]);
+            if(count > 1 && !conflict)
+                res->conflicts++;
+            conflict = count > 1;
+        }
+    }
+}
+
+static void result_add(struct sim_result* dst, const struct sim_result* src){
+    dst->arrived += src->arrived;
+    dst->passed += src->passed;
+    dst->detected += src->detected;
+    dst->detections += src->detections;
+    dst->false_stops += src->false_stops;
+    dst->unsafe += src->unsafe;
+    dst->conflicts += src->conflicts;
+    dst->early_releases += src->early_releases;
+    dst->forced += src->forced;
+    dst->refused += src->refused;
+    dst->forced_on_loop += src->forced_on_loop;
+    dst->samples += src->samples;
+    dst->queue_ms += src->queue_ms;
+    if(src->max_queue > dst->max_queue)
+        dst->max_queue = src->max_queue;
+}
+
+/* Workers take groups one by one so uneven ramps do not leave cores idle */
+struct worker {
+    pthread_t th;
+    const struct sim_cfg* cfg;
+    struct sim_result res;
+};
+
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+static int next_ramp;
+
+static void* worker_fun(void* param){
+    struct worker* w = param;
+    int idx;
+
+    while(1){
+        pthread_mutex_lock(&next_lock);
+            idx = next_ramp++;
+        pthread_mutex_unlock(&next_lock);
+        if(idx >= w->cfg->ramps / w->cfg->group)
+            break;
+        run_group(idx, w->cfg, &w->res);
+    }
+    return NULL;
+}
+
+/* Reads recorded arrival times in seconds, returns number of arrivals or -1 */
+static long load_arrivals(const char* path, double** out){
+    FILE* f = fopen(path, "r");
+    double* a = NULL;
+    size_t n = 0, cap = 0;
+    double s;
+
+    if(f == NULL)
+        return -1;
+    while(fscanf(f, "%lf", &s) == 1){
+        if(n == cap){
+            cap = cap ? cap * 2 : 256;
+            a = realloc(a, cap * sizeof(*a));
+            if(a == NULL){
+                fclose(f);
+                return -1;
+            }
+        }
+        a[n++] = s * 1000;
+    }
+    fclose(f);
+    if(n == 0){
+        free(a);
+        return -1;
+    }
+    *out = a;
+    return n;
+}
+
+static void report(const char* name, const struct sim_cfg* cfg, const struct sim_result* res, double hours){
+    printf("%-14s %10.1f %10.1f %9.2f %7.1f %6u %8.3f %8.3f %10.3f %10.4f %8.1f%% %8.1f\n", name,
+           res->passed / hours / cfg->ramps, res->arrived / hours / cfg->ramps,
+           res->queue_ms / cfg->end_ms / cfg->ramps, res->arrived ? res->queue_ms / res->arrived / 1000 : 0.0,
+           res->max_queue, res->false_stops / hours / cfg->ramps, res->unsafe / hours / cfg->ramps,
+           res->conflicts / hours / cfg->ramps, (double)res->samples / cfg->end_ms / cfg->ramps,
+           res->passed ? 100.0 * res->detected / res->passed : 0.0, res->early_releases / hours / cfg->ramps);
+    if(cfg->force_per_ms > 0)
+        printf("%-14s %10.1f force-close/h accepted, %.1f/h refused, %.3f/h accepted on an occupied loop\n", "",
+               res->forced / hours / cfg->ramps, res->refused / hours / cfg->ramps,
+               res->forced_on_loop / hours / cfg->ramps);
+}
+
+/* Simulates all ramps with the current configuration and reports one row */
+static void run_all(const char* name, struct sim_cfg* cfg, struct worker* workers, long threads, double hours){
+    struct sim_result total;
+    int i;
+
+    next_ramp = 0;
+    for(i = 0; i < threads; i++){
+        memset(&workers[i].res, 0, sizeof(workers[i].res));
+        workers[i].cfg = cfg;
+        pthread_create(&workers[i].th, NULL, worker_fun, &workers[i]);
+    }
+    memset(&total, 0, sizeof(total));
+    for(i = 0; i < threads; i++){
+        pthread_join(workers[i].th, NULL);
+        result_add(&total, &workers[i].res);
+    }
+    report(name, cfg, &total, hours);
+}
+
+int main(int argc, char* argv[])
+{
+    static struct worker workers[MAX_THREADS];
+    struct sim_cfg cfg;
+    const char* arrivals_path = NULL;
+    const char* only = NULL;
+    double hours = 1, per_hour = 120;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    long n;
+    int opt, p, c;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.ramps = 1000;
+    cfg.spike_rate = 1e-6;
+    cfg.group = 1;
+    cfg.coord = -1;
+    cfg.clear_ms = PAIR_CLEAR_MS;
+    cfg.debounce_ms = CLEAR_DEBOUNCE_MS;
+    while((opt = getopt(argc, argv, "n:H:l:a:s:j:P:R:Ag:c:LF:")) != -1){
+        switch(opt){
+            case 'n': cfg.ramps = atoi(optarg); break;
+            case 'H': hours = atof(optarg); break;
+            case 'l': per_hour = atof(optarg); break;
+            case 'a': arrivals_path = optarg; break;
+            case 's': cfg.spike_rate = atof(optarg); break;
+            case 'j': threads = atol(optarg); break;
+            case 'P': only = optarg; break;
+            case 'R': cfg.debounce_ms = atoi(optarg); break;
+            case 'A': cfg.predict = 1; break;
+            case 'g': cfg.group = atoi(optarg); break;
+            case 'c': cfg.clear_ms = atoi(optarg); break;
+            case 'L': cfg.loop = 1; break;
+            case 'F': cfg.force_per_ms = atof(optarg) / 3600000; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n ramps] [-H hours] [-l vehicles_per_hour] [-a arrivals_file] [-s spike_rate] [-j threads] [-P policy] [-R clear_debounce_ms] [-A] [-g group_size [-c clearance_ms]] [-L] [-F force_closes_per_hour]\n", argv[0]);
+                return -1;
+        }
+    }
+    if(cfg.group < 1 || cfg.group > PAIR_LANES || cfg.ramps < cfg.group){
+        fprintf(stderr, "Group size must be 1 to %d and not above the number of ramps\n", PAIR_LANES);
+        return -1;
+    }
+    cfg.ramps -= cfg.ramps % cfg.group;
+    if(threads < 1)
+        threads = 1;
+    if(threads > MAX_THREADS)
+        threads = MAX_THREADS;
+    cfg.end_ms = (uint64_t)(hours * 3600000);
+    cfg.rate_per_ms = per_hour / 3600000;
+    if(arrivals_path != NULL){
+        n = load_arrivals(arrivals_path, &cfg.arrivals);
+        if(n < 0){
+            perror("FATAL ERROR: Failed reading arrivals file !!\n");
+            return -1;
+        }
+        cfg.arrival_count = n;
+    }
+
+    printf("%d ramps, %.2f h, %ld threads, %s arrivals\n", cfg.ramps, hours, threads,
+           arrivals_path != NULL ? arrivals_path : "poisson");
+    if(cfg.group > 1)
+        printf("groups of %d sharing one passage, %llu ms clearance\n", cfg.group, (unsigned long long)cfg.clear_ms);
+    printf("%-14s %10s %10s %9s %7s %6s %8s %8s %10s %10s %9s %8s\n", "policy", "passed/h", "arrived/h", "avg queue",
+           "wait s", "max q", "false/h", "unsafe/h", "conflict/h", "samples/ms", "detected", "early/h");
+    for(p = 0; p < POLICY_COUNT; p++){
+        if(only != NULL && strcmp(only, policies[p].name) != 0)
+            continue;
+        cfg.pol = &policies[p];
+        if(cfg.group == 1){
+            run_all(cfg.pol->name, &cfg, workers, threads, hours);
+            continue;
+        }
+        /* Groups: the timing policy with each coordination, only the first policy unless -P picks one */
+        for(c = -1; c <= PAIR_ADAPTIVE; c++){
+            cfg.coord = c;
+            run_all(c < 0 ? "pair-none" : coord_name[c], &cfg, workers, threads, hours);
+        }
+        if(only == NULL)
+            break;
+    }
+    free(cfg.arrivals);
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "site.h"
+
+/*
+    Site occupancy aggregator. Takes passage events posted by the ramps of one lot, keeps the number
+    of vehicles inside and sets the full flag that holds entry ramps at RED. Every pass refreshes alive_us,
+    ramps ignore the flag once it is older than SITE_STALE_MS. Occupancy is kept in the shared segment,
+    so restarting the aggregator does not lose it.
+    Usage: ramp_site -c capacity [-o occupancy] [-s shm_name]
+*/
+
+#define IDLE_SLEEP_NS 1000000L /* Poll period while the queue is empty */
+
+static uint64_t mono_us(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char* argv[])
+{
+    struct timespec idle = { 0, IDLE_SLEEP_NS };
+    const char* name = SITE_SHM;
+    struct site_event ev;
+    struct site site;
+    int capacity = -1;
+    int occupancy = -1;
+    int32_t occ;
+    int opt;
+
+    while((opt = getopt(argc, argv, "c:o:s:")) != -1){
+        switch(opt){
+            case 'c': capacity = atoi(optarg); break;
+            case 'o': occupancy = atoi(optarg); break;
+            case 's': name = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s -c capacity [-o occupancy] [-s shm_name]\n", argv[0]);
+                return -1;
+        }
+    }
+    if(capacity <= 0){
+        fprintf(stderr, "Usage: %s -c capacity [-o occupancy] [-s shm_name]\n", argv[0]);
+        return -1;
+    }
+    if(site_open(&site, name, 1) < 0){
+        perror("FATAL ERROR: Failed opening site shared memory !!\n");
+        return -1;
+    }
+
+    atomic_store(&site.shm->capacity, capacity);
+    if(occupancy >= 0)
+        atomic_store(&site.shm->occupancy, occupancy);
+    occ = atomic_load(&site.shm->occupancy);
+    atomic_store(&site.shm->full, occ >= capacity);
+    atomic_store(&site.shm->alive_us, mono_us());
+    printf("%s site %s, occupancy %d/%d\n", site.created ? "Created" : "Resumed", name, occ, capacity);
+    fflush(stdout);
+
+    while(1){
+        atomic_store_explicit(&site.shm->alive_us, mono_us(), memory_order_relaxed);
+        if(!site_take(&site, &ev)){
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        occ = atomic_load_explicit(&site.shm->occupancy, memory_order_relaxed);
+        if(ev.dir == SITE_ENTRY)
+            occ++;
+        else if(occ > 0)
+            occ--;
+        atomic_store_explicit(&site.shm->occupancy, occ, memory_order_relaxed);
+        atomic_store_explicit(&site.shm->full, occ >= capacity, memory_order_relaxed);
+        if(ev.lane < SITE_LANES)
+            atomic_fetch_add_explicit(&site.shm->lane_vehicles[ev.lane], 1, memory_order_relaxed);
+
+        printf("lane %u %s after %u ms, occupancy %d/%d%s\n", ev.lane, ev.dir == SITE_ENTRY ? "entry" : "exit",
+               ev.dwell_ms, occ, capacity, occ >= capacity ? " FULL" : "");
+        fflush(stdout);
+    }
+    return 0;
+}
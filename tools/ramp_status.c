@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "ramp_status.h"
+
+/*
+    Shows live ramp state from the status page of ramp_status.ko. The page is mapped read-only,
+    so polling costs no syscalls and never contends with the control path.
+    Usage: ramp_status [interval_ms]   (without interval the state is printed once)
+*/
+
+static const char* light_name[] = { "OFF", "RED", "YELLOW", "GREEN" };
+static const char* boom_name[] = { "down", "up", "moving down", "moving up" };
+
+static unsigned long long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void print_status(const struct ramp_status* st){
+    unsigned long long now = now_ns();
+
+    printf("light=%s boom_cmd=%s boom=%s buzzer=%s sample=0x%03x age_ms=%llu flags=0x%02x "
+           "lights=%u moves=%u buzzes=%u conversions=%u errors=%u wd_led=%u wd_pwm=%u\n",
+           light_name[st->light & 3], boom_name[st->boom_cmd & 1], boom_name[ramp_status_boom_pos(st, now) & 3],
+           st->buzzer ? "on" : "off", st->sample_raw, st->sample_ns ? (now - st->sample_ns) / 1000000 : 0,
+           st->sample_flags, st->light_changes, st->boom_moves, st->buzzes, st->conversions, st->read_errors,
+           st->led_wd_trips, st->pwm_wd_trips);
+    if(st->first_phase_ns != 0)
+        printf("load to first controlled phase: %.3f ms\n", (st->first_phase_ns - st->load_ns) / 1e6);
+}
+
+int main(int argc, char* argv[])
+{
+    const volatile struct ramp_status* page;
+    struct ramp_status st;
+    int interval_ms = argc > 1 ? atoi(argv[1]) : 0;
+    struct timespec ts;
+    int fd;
+
+    fd = open(RAMP_STATUS_DEVICE, O_RDONLY);
+    if(fd < 0){
+        perror("Failed opening " RAMP_STATUS_DEVICE);
+        return -1;
+    }
+    page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(page == MAP_FAILED){
+        perror("Failed mapping status page");
+        return -1;
+    }
+    if(page->magic != RAMP_STATUS_MAGIC){
+        fprintf(stderr, "Unknown status page layout\n");
+        return -1;
+    }
+
+    ts.tv_sec = interval_ms / 1000;
+    ts.tv_nsec = (interval_ms % 1000) * 1000000L;
+    do{
+        ramp_status_read(page, &st);
+        print_status(&st);
+        if(interval_ms > 0)
+            nanosleep(&ts, NULL);
+    }while(interval_ms > 0);
+    return 0;
+}
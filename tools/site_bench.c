@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "site.h"
+
+/*
+    Ingestion benchmark of the site queue. Producer threads stand in for ramp processes and post bursts
+    of passage events as fast as they can while one consumer drains the queue like ramp_site does.
+    Reports consumed events per second, events dropped because the queue was full and the slowest
+    single post, which is the longest a ramp's sensor loop can be delayed by the site.
+    Usage: site_bench [lanes] [events_per_lane] [burst]
+*/
+
+#define BENCH_SHM "/ramp_site_bench"
+
+struct producer {
+    pthread_t th;
+    struct site* site;
+    int lane;
+    long events;
+    int burst;
+    long dropped;
+    uint64_t max_post_ns;
+};
+
+static uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void* producer_fun(void* param){
+    struct producer* p = param;
+    struct site_event ev;
+    uint64_t t0, t;
+    long i;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.lane = p->lane;
+    ev.dir = p->lane % 2 ? SITE_EXIT : SITE_ENTRY;
+    for(i = 0; i < p->events; i++){
+        ev.t_us = i;
+        t0 = now_ns();
+        if(site_post(p->site, &ev) < 0)
+            p->dropped++;
+        t = now_ns() - t0;
+        if(t > p->max_post_ns)
+            p->max_post_ns = t;
+        /* Lanes go quiet between bursts */
+        if((i + 1) % p->burst == 0)
+            sched_yield();
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    int lanes = argc > 1 ? atoi(argv[1]) : 48;
+    long events = argc > 2 ? atol(argv[2]) : 100000;
+    int burst = argc > 3 ? atoi(argv[3]) : 64;
+    struct producer* p;
+    struct site_event ev;
+    struct site site;
+    uint64_t start, elapsed, max_post = 0;
+    long consumed = 0, dropped = 0;
+    int i;
+
+    shm_unlink(BENCH_SHM);
+    if(lanes <= 0 || events <= 0 || burst <= 0 || site_open(&site, BENCH_SHM, 1) < 0){
+        fprintf(stderr, "Usage: %s [lanes] [events_per_lane] [burst]\n", argv[0]);
+        return -1;
+    }
+    p = calloc(lanes, sizeof(*p));
+
+    start = now_ns();
+    for(i = 0; i < lanes; i++){
+        p[i].site = &site;
+        p[i].lane = i;
+        p[i].events = events;
+        p[i].burst = burst;
+        pthread_create(&p[i].th, NULL, producer_fun, &p[i]);
+    }
+
+    /* Consumer runs in the main thread until every event was either taken or dropped */
+    while(consumed + (long)atomic_load(&site.shm->dropped) < lanes * events)
+        if(site_take(&site, &ev))
+            consumed++;
+    elapsed = now_ns() - start;
+
+    for(i = 0; i < lanes; i++){
+        pthread_join(p[i].th, NULL);
+        dropped += p[i].dropped;
+        if(p[i].max_post_ns > max_post)
+            max_post = p[i].max_post_ns;
+    }
+    printf("%d lanes, %ld events each, bursts of %d\n", lanes, events, burst);
+    printf("consumed %ld events in %.3f s, %.0f events/s\n", consumed, elapsed / 1e9, consumed / (elapsed / 1e9));
+    printf("dropped %ld (%.3f %%), slowest post %.1f us\n", dropped, 100.0 * dropped / ((double)lanes * events),
+           max_post / 1e3);
+
+    site_close(&site);
+    shm_unlink(BENCH_SHM);
+    free(p);
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "trace.h"
+#include "calib.h"
+
+/*
+    Decoder of sensor traces in either format. Lists samples as "<seconds> adc <raw> <mm>" and actuator commands
+    as "<seconds> <device> <command>", the same lines replay prints, from -f to -u seconds after the start. Seeks
+    to -f through the block headers. -c / -r convert the listed range to the compact or raw format, -q lists
+    nothing. Prints size per sample and compression against the raw format, and with -b the encode cost of
+    the compact coder per record, measured by coding the records again into /dev/null.
+    Usage: trace_dump [-f from_s] [-u until_s] [-k calibration_file] [-c compact_out | -r raw_out] [-q] [-b] file
+*/
+
+#define BENCH_CHUNK 65536 /* Records coded per timed run with -b */
+
+static uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Codes a chunk of records into bench and returns the time it took */
+static uint64_t bench_chunk(struct trace* bench, const struct trace_record* recs, int n){
+    uint64_t t0 = now_ns();
+    int i;
+
+    for(i = 0; i < n; i++)
+        trace_write(bench, &recs[i]);
+    return now_ns() - t0;
+}
+
+int main(int argc, char* argv[])
+{
+    struct trace tr, out, bench;
+    struct trace_record rec;
+    struct trace_record* recs = NULL;
+    const char* out_path = NULL;
+    const char* calib_path = NULL;
+    enum trace_format out_format = TRACE_COMPACT;
+    double from_s = 0, until_s = -1;
+    uint64_t from_us, until_us = 0, t, bench_ns = 0;
+    unsigned long listed = 0, bench_records = 0;
+    int quiet = 0, do_bench = 0;
+    int nrecs = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "f:u:k:c:r:qb")) != -1){
+        switch(opt){
+            case 'f': from_s = atof(optarg); break;
+            case 'u': until_s = atof(optarg); break;
+            case 'k': calib_path = optarg; break;
+            case 'c': out_path = optarg; out_format = TRACE_COMPACT; break;
+            case 'r': out_path = optarg; out_format = TRACE_RAW; break;
+            case 'q': quiet = 1; break;
+            case 'b': do_bench = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-f from_s] [-u until_s] [-k calibration_file] [-c compact_out | -r raw_out] [-q] [-b] file\n", argv[0]);
+                return -1;
+        }
+    }
+    if(optind >= argc){
+        fprintf(stderr, "Usage: %s [-f from_s] [-u until_s] [-k calibration_file] [-c compact_out | -r raw_out] [-q] [-b] file\n", argv[0]);
+        return -1;
+    }
+    calib_default();
+    if(calib_path != NULL && calib_load(calib_path) < 0){
+        perror("Failed reading calibration file");
+        return -1;
+    }
+    if(trace_open(&tr, argv[optind]) < 0){
+        perror("Failed opening trace");
+        return -1;
+    }
+    rec.t_us = tr.start_us;
+    from_us = tr.start_us + (uint64_t)(from_s * 1e6);
+    if(until_s >= 0)
+        until_us = tr.start_us + (uint64_t)(until_s * 1e6);
+    if(from_s > 0 && trace_seek(&tr, from_us) < 0){
+        perror("Failed seeking trace");
+        return -1;
+    }
+    if(out_path != NULL && trace_create(&out, out_path, tr.start_us, out_format) < 0){
+        perror("Failed creating output trace");
+        return -1;
+    }
+    /* Wall clock of the output is the one of the input */
+    if(out_path != NULL){
+        int64_t wall = tr.wall_start;
+        fseek(out.f, TRACE_MAGIC_LEN, SEEK_SET);
+        fwrite(&wall, sizeof(wall), 1, out.f);
+        fseek(out.f, 0, SEEK_END);
+    }
+    if(do_bench){
+        recs = malloc(BENCH_CHUNK * sizeof(*recs));
+        if(recs == NULL || trace_create(&bench, "/dev/null", tr.start_us, TRACE_COMPACT) < 0){
+            perror("Failed setting up encode benchmark");
+            return -1;
+        }
+    }
+
+    while(trace_next(&tr, &rec)){
+        if(rec.t_us < from_us)
+            continue;
+        if(until_us != 0 && rec.t_us > until_us)
+            break;
+        listed++;
+        if(!quiet){
+            t = rec.t_us - tr.start_us;
+            if(rec.event == TRACE_EV_NONE)
+                printf("%llu.%06llu adc %u %u\n", (unsigned long long)(t / 1000000), (unsigned long long)(t % 1000000),
+                       calib_raw(rec.data), calib_mm(rec.data));
+            else
+                printf("%llu.%06llu %s\n", (unsigned long long)(t / 1000000), (unsigned long long)(t % 1000000),
+                       trace_event_name(rec.event));
+        }
+        if(out_path != NULL && trace_write(&out, &rec) < 0){
+            perror("Failed writing output trace");
+            return -1;
+        }
+        if(do_bench){
+            recs[nrecs++] = rec;
+            if(nrecs == BENCH_CHUNK){
+                bench_ns += bench_chunk(&bench, recs, nrecs);
+                bench_records += nrecs;
+                nrecs = 0;
+            }
+        }
+    }
+    if(do_bench && nrecs > 0){
+        bench_ns += bench_chunk(&bench, recs, nrecs);
+        bench_records += nrecs;
+    }
+
+    fprintf(stderr, "%s trace, %lu samples, %lu actuator commands, %lu records listed, %.1f s\n",
+            tr.format == TRACE_COMPACT ? "Compact" : "Raw", tr.records, tr.events, listed,
+            (rec.t_us - tr.start_us) / 1e6);
+    /* Sizes only mean something for the whole trace */
+    if(tr.records > 0 && from_s <= 0 && until_s < 0)
+        fprintf(stderr, "Read %llu bytes, %.2f bytes per sample, raw format would take %llu (%.1fx)\n",
+                (unsigned long long)tr.bytes, (double)tr.bytes / tr.records,
+                (unsigned long long)(TRACE_HEADER_LEN + 10ULL * tr.records), (double)(TRACE_HEADER_LEN + 10ULL * tr.records) / tr.bytes);
+    if(tr.format == TRACE_COMPACT)
+        fprintf(stderr, "%lu blocks read\n", tr.blocks);
+    if(out_path != NULL){
+        trace_close(&out);
+        fprintf(stderr, "Wrote %llu bytes to %s\n", (unsigned long long)out.bytes, out_path);
+    }
+    if(do_bench){
+        trace_close(&bench);
+        if(bench_records > 0)
+            fprintf(stderr, "Encode %.1f ns per record, %.2f bytes per record, %lu blocks\n",
+                    (double)bench_ns / bench_records, (double)bench.bytes / bench_records, bench.blocks);
+        free(recs);
+    }
+    trace_close(&tr);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "uring_io.h"
+
+/*
+    Compares one control decision (ADC read, LED, PWM and buzzer write) done with plain read()/write()
+    against the io_uring path of ramp_app. Reports time, syscalls and context switches per decision.
+    Without arguments /dev/zero stands in for the ADC and /dev/null for the actuators, so both paths
+    run on the same stand-in; pass real driver paths to measure on the target.
+    Usage: uring_bench [iterations] [adc_path led_path pwm_path buzz_path]
+*/
+
+#define BUF_LEN 10
+#define ADC_TIMEOUT_US 150000
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static long context_switches(void){
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+static void report(const char* name, long iterations, double ns, unsigned long syscalls, long csw){
+    printf("%-10s %10.0f ns/decision %6.2f syscalls/decision %8.4f ctx switches/decision\n",
+           name, ns / iterations, (double)syscalls / iterations, (double)csw / iterations);
+}
+
+int main(int argc, char* argv[])
+{
+    char buf[3][BUF_LEN] = { "RED", "YELLOW", "GREEN" };
+    const char* adc_path = "/dev/zero";
+    const char* out_path[3] = { "/dev/null", "/dev/null", "/dev/null" };
+    long iterations = argc > 1 ? atol(argv[1]) : 100000;
+    struct uring_io act, adc;
+    int fds[4];
+    char data[2];
+    double start;
+    long csw, i;
+    int k, slot;
+
+    if(argc > 5){
+        adc_path = argv[2];
+        out_path[0] = argv[3];
+        out_path[1] = argv[4];
+        out_path[2] = argv[5];
+    }
+    fds[3] = open(adc_path, O_RDONLY);
+    for(k = 0; k < 3; k++)
+        fds[k] = open(out_path[k], O_WRONLY);
+    if(fds[0] < 0 || fds[1] < 0 || fds[2] < 0 || fds[3] < 0){
+        perror("open");
+        return -1;
+    }
+
+    csw = context_switches();
+    start = now_ns();
+    for(i = 0; i < iterations; i++){
+        read(fds[3], data, 2);
+        for(k = 0; k < 3; k++)
+            write(fds[k], buf[i % 3], BUF_LEN);
+    }
+    report("syscall", iterations, now_ns() - start, iterations * 4, context_switches() - csw);
+
+    if(uring_io_init(&act, fds, 3) < 0 || uring_io_init(&adc, &fds[3], 1) < 0){
+        perror("io_uring");
+        return -1;
+    }
+    csw = context_switches();
+    start = now_ns();
+    for(i = 0; i < iterations; i++){
+        slot = uring_io_read(&adc, 0, 2, ADC_TIMEOUT_US);
+        if(uring_io_submit(&adc) == 0)
+            memcpy(data, adc.bufs[slot], 2);
+        for(k = 0; k < 3; k++)
+            uring_io_write(&act, k, buf[i % 3], BUF_LEN);
+        uring_io_submit(&act);
+    }
+    report("io_uring", iterations, now_ns() - start, act.enters + adc.enters, context_switches() - csw);
+
+    uring_io_exit(&act);
+    uring_io_exit(&adc);
+    for(k = 0; k < 4; k++)
+        close(fds[k]);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <string.h>
+#include <math.h>
+#include "baseline.h"
+
+#define BASELINE_MAX_GAP_S 1.0 /* Longer gaps between used samples count as this long */
+
+void baseline_init(struct baseline* b, unsigned nominal_mm){
+    memset(b, 0, sizeof(*b));
+    b->nominal_mm = nominal_mm;
+    b->threshold_mm = nominal_mm;
+}
+
+/* Threshold for the current floor, between BASELINE_MIN_MM and the nominal threshold */
+static unsigned baseline_threshold(const struct baseline* b){
+    double limit = b->floor_mm - BASELINE_MARGIN_MM;
+
+    if(b->empty_s < BASELINE_SETTLE_S || limit >= b->nominal_mm)
+        return b->nominal_mm;
+    if(limit < BASELINE_MIN_MM)
+        return BASELINE_MIN_MM;
+    return (unsigned)limit;
+}
+
+/*
+    Adds one confirmed empty lane sample. Averages are weighted by the time since the previous sample, so the
+    idle sampling rate does not change the time constant; while settling they are plain averages. The floor
+    moves down by (1 - p) steps on samples below it and up by p steps otherwise, so it settles where a share p
+    of samples is below it. Its step is scaled by the deviation, so it follows at the pace of the averages.
+*/
+static void baseline_use(struct baseline* b, uint64_t t_us, unsigned mm){
+    double dt, alpha, alpha_t, step, d;
+
+    b->samples++;
+    if(b->samples == 1){
+        b->mean_mm = mm;
+        b->t_last = t_us;
+        return;
+    }
+    dt = b->t_last != 0 && t_us > b->t_last ? (t_us - b->t_last) / 1e6 : 0;
+    if(dt > BASELINE_MAX_GAP_S)
+        dt = BASELINE_MAX_GAP_S;
+    b->t_last = t_us;
+    b->empty_s += dt;
+
+    alpha = alpha_t = 1.0 - exp(-dt / BASELINE_TAU_S);
+    if(b->empty_s < BASELINE_SETTLE_S && alpha < 1.0 / b->samples)
+        alpha = 1.0 / b->samples;
+    d = mm - b->mean_mm;
+    b->mean_mm += alpha * d;
+    b->var_mm2 = (1.0 - alpha) * (b->var_mm2 + alpha * d * d);
+
+    /* Floor starts at the quantile of a normal distribution with the settled mean and deviation */
+    if(b->empty_s < BASELINE_SETTLE_S){
+        b->floor_mm = b->mean_mm - 2.33 * sqrt(b->var_mm2);
+        return;
+    }
+    step = alpha_t * fmax(sqrt(b->var_mm2), BASELINE_MIN_NOISE_MM) / BASELINE_FLOOR_P;
+    if(mm < b->floor_mm)
+        b->floor_mm -= step * (1.0 - BASELINE_FLOOR_P);
+    else
+        b->floor_mm += step * BASELINE_FLOOR_P;
+}
+
+/*
+    Feeds one sample. Samples of an empty lane wait BASELINE_CONFIRM_MS and are dropped if the lane gets
+    occupied in the meantime. Returns the threshold to use from now on.
+*/
+unsigned baseline_feed(struct baseline* b, uint64_t t_us, unsigned mm, int lane_empty){
+    unsigned threshold, tail;
+
+    if(!lane_empty || mm <= b->threshold_mm){
+        b->pend_count = 0;
+        b->t_last = 0;
+        return b->threshold_mm;
+    }
+
+    if(b->pend_count == BASELINE_PENDING){
+        tail = (b->pend_head + BASELINE_PENDING - b->pend_count) % BASELINE_PENDING;
+        baseline_use(b, b->pend_t[tail], b->pend_mm[tail]);
+        b->pend_count--;
+    }
+    b->pend_t[b->pend_head] = t_us;
+    b->pend_mm[b->pend_head] = mm;
+    b->pend_head = (b->pend_head + 1) % BASELINE_PENDING;
+    b->pend_count++;
+
+    while(b->pend_count > 0){
+        tail = (b->pend_head + BASELINE_PENDING - b->pend_count) % BASELINE_PENDING;
+        if(t_us - b->pend_t[tail] < BASELINE_CONFIRM_MS * 1000ULL)
+            break;
+        baseline_use(b, b->pend_t[tail], b->pend_mm[tail]);
+        b->pend_count--;
+    }
+
+    threshold = baseline_threshold(b);
+    if(threshold != b->threshold_mm){
+        b->threshold_mm = threshold;
+        b->adjustments++;
+    }
+    return threshold;
+}
+
+void baseline_print(const struct baseline* b, FILE* out){
+    fprintf(out, "Baseline: %.1f mm, noise %.1f mm, floor %.1f mm, threshold %u mm (nominal %u), %llu adjustments\n",
+            b->mean_mm, sqrt(b->var_mm2), b->floor_mm, b->threshold_mm, b->nominal_mm,
+            (unsigned long long)b->adjustments);
+}
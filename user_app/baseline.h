@@ -0,0 +1,47 @@
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+    Ambient baseline of the distance sensor. Sunlight, dirt on the lens and temperature make the empty lane
+    read closer than it is, until its noise reaches a fixed threshold and stops the ramp for nothing. The empty
+    lane distance is tracked incrementally: its mean and deviation as exponential averages over BASELINE_TAU_S,
+    and its floor (the BASELINE_FLOOR_P quantile) by stochastic approximation. The detection threshold is kept
+    BASELINE_MARGIN_MM below the floor, never above the configured value and never below BASELINE_MIN_MM,
+    so a vehicle under the boom is always detected. Samples are only used once the lane stayed empty for
+    BASELINE_CONFIRM_MS after them, so an approaching vehicle does not pull the baseline down.
+*/
+#define BASELINE_TAU_S 60.0         /* Time constant of the averages */
+#define BASELINE_SETTLE_S 5.0       /* Empty lane time before the threshold is adjusted */
+#define BASELINE_FLOOR_P 0.01       /* Share of empty lane samples below the floor (2.33 deviations below the mean if normal) */
+#define BASELINE_MARGIN_MM 20       /* Threshold stays this far below the floor */
+#define BASELINE_MIN_MM 120         /* Lowest threshold allowed */
+#define BASELINE_MIN_NOISE_MM 5.0   /* Floor step is scaled by the deviation, at least this */
+#define BASELINE_CONFIRM_MS 1000    /* Lane must stay empty this long after a sample before it is used */
+#define BASELINE_PENDING 1024       /* Samples waiting for confirmation, oldest are used early on overflow */
+
+struct baseline {
+    unsigned nominal_mm;      /* Configured threshold */
+    unsigned threshold_mm;    /* Threshold in use */
+    double mean_mm;           /* Empty lane distance */
+    double var_mm2;           /* Empty lane variance */
+    double floor_mm;          /* Empty lane distance only BASELINE_FLOOR_P of samples are below */
+    double empty_s;           /* Empty lane time averaged so far */
+    uint64_t t_last;          /* Last used sample, 0 after a gap */
+    uint64_t samples;         /* Samples used */
+    uint64_t adjustments;     /* Threshold changes */
+
+    /* Samples waiting for confirmation */
+    uint64_t pend_t[BASELINE_PENDING];
+    uint16_t pend_mm[BASELINE_PENDING];
+    unsigned pend_head;
+    unsigned pend_count;
+};
+
+void baseline_init(struct baseline* b, unsigned nominal_mm);
+unsigned baseline_feed(struct baseline* b, uint64_t t_us, unsigned mm, int lane_empty);
+void baseline_print(const struct baseline* b, FILE* out);
+
+#endif
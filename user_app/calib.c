@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include "calib.h"
+
+uint16_t calib_lut[CALIB_RAW_COUNT];
+
+struct calib_point {
+    unsigned raw;
+    unsigned mm;
+};
+
+/* Default curve of the ramp IR sensor, raw sample -> distance, raw must be increasing */
+static const struct calib_point default_points[] = {
+    { 0x000, 1000 }, { 0x150, 800 }, { 0x200, 600 }, { 0x300, 450 }, { 0x400, 350 }, { 0x500, 280 },
+    { 0x600, 230 }, { 0x700, 195 }, { 0x800, 170 }, { 0x900, 150 }, { 0xA00, 130 }, { 0xC00, 105 },
+    { 0xE00, 85 }, { 0xFFF, 70 }
+};
+
+/* Fills the table by linear interpolation between points, values outside the points are clamped */
+static void calib_build(const struct calib_point* pts, int n){
+    unsigned raw;
+    int i = 0;
+
+    for(raw = 0; raw < CALIB_RAW_COUNT; raw++){
+        while(i < n - 1 && raw > pts[i + 1].raw)
+            i++;
+        if(raw <= pts[0].raw)
+            calib_lut[raw] = pts[0].mm;
+        else if(i == n - 1)
+            calib_lut[raw] = pts[n - 1].mm;
+        else
+            calib_lut[raw] = pts[i].mm + ((int)pts[i + 1].mm - (int)pts[i].mm) * (int)(raw - pts[i].raw) /
+                             (int)(pts[i + 1].raw - pts[i].raw);
+    }
+}
+
+void calib_default(void){
+    calib_build(default_points, sizeof(default_points) / sizeof(default_points[0]));
+}
+
+/* Loads calibration points from a file with "<raw> <mm>" per line, raw increasing. Returns 0 on success */
+int calib_load(const char* path){
+    struct calib_point pts[CALIB_MAX_POINTS];
+    FILE* f = fopen(path, "r");
+    unsigned mm;
+    int raw, n = 0;
+
+    if(f == NULL)
+        return -1;
+    while(n < CALIB_MAX_POINTS && fscanf(f, "%i %u", &raw, &mm) == 2){
+        if(raw < 0 || raw >= CALIB_RAW_COUNT || (n > 0 && (unsigned)raw <= pts[n - 1].raw)){
+            fclose(f);
+            return -1;
+        }
+        pts[n].raw = raw;
+        pts[n].mm = mm;
+        n++;
+    }
+    fclose(f);
+    if(n < 2)
+        return -1;
+    calib_build(pts, n);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef CALIB_H
+#define CALIB_H
+
+#include <stdint.h>
+
+/*
+    Distance calibration of the IR sensor. adc_driver returns a 12-bit sample in two bytes (4 MSBs of the
+    first byte unused). The sensor output is strongly nonlinear in distance, so the curve given by a few
+    calibration points is interpolated once into a table indexed by the raw sample, and every conversion
+    is a single lookup.
+*/
+#define CALIB_RAW_COUNT 4096
+#define CALIB_MAX_POINTS 64
+
+/* Decodes the full 12-bit sample */
+static inline unsigned calib_raw(const unsigned char data[2]){
+    return ((data[0] & 0x0F) << 8) | data[1];
+}
+
+extern uint16_t calib_lut[CALIB_RAW_COUNT];
+
+/* Distance in millimetres for a sample */
+static inline unsigned calib_mm(const unsigned char data[2]){
+    return calib_lut[calib_raw(data)];
+}
+
+void calib_default(void);
+int calib_load(const char* path);
+
+#endif
@@ -0,0 +1,32 @@
+#include "ramp.h"
+
+/*
+    Time source of the controller. Normally CLOCK_MONOTONIC and the wall clock are used directly,
+    when replaying a trace the replay loop moves the virtual clock from one event to the next.
+*/
+
+int clock_virtual = 0;
+uint64_t clock_virtual_us = 0;
+static time_t virtual_wall_base;
+static uint64_t virtual_start_us;
+
+/* Switches to virtual time starting at start_us, which corresponds to wall clock time wall_base */
+void clock_use_virtual(time_t wall_base, uint64_t start_us){
+    virtual_wall_base = wall_base;
+    virtual_start_us = start_us;
+    clock_virtual_us = start_us;
+    clock_virtual = 1;
+}
+
+/* Moves the virtual clock, time never goes backwards */
+void clock_set(uint64_t t_us){
+    if(t_us > clock_virtual_us)
+        clock_virtual_us = t_us;
+}
+
+/* Wall clock time in seconds, used for per-hour statistics */
+time_t wall_time(void){
+    if(clock_virtual)
+        return virtual_wall_base + (time_t)((clock_virtual_us - virtual_start_us) / 1000000);
+    return time(NULL);
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "control.h"
+#include "metrics.h"
+
+/*
+    Operator control socket. Clients send newline separated commands, any number per write.
+    Commands from all clients are executed in batches of at most CONTROL_MAX_BATCH per main loop
+    iteration and replies for one batch are sent with a single write per client, so a burst from a
+    site controller cannot starve the phase cycle and every command gets its reply in bounded time.
+*/
+
+#define CLIENT_BUF_LEN (CONTROL_LINE_LEN * 4)
+
+struct client {
+    int fd;
+    char in[CLIENT_BUF_LEN];
+    size_t in_len;
+    char out[CONTROL_MAX_BATCH * CONTROL_REPLY_LEN];
+    size_t out_len;
+};
+
+static int listen_fd = -1;
+static struct client clients[CONTROL_MAX_CLIENTS];
+uint64_t control_batch_us;
+
+static void set_nonblock(int fd){
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/* Creates control socket on given path, returns 0 on success */
+int control_open(const char* path){
+    struct sockaddr_un addr;
+    int i;
+
+    for(i = 0; i < CONTROL_MAX_CLIENTS; i++)
+        clients[i].fd = -1;
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if(bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, CONTROL_MAX_CLIENTS) < 0){
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    set_nonblock(listen_fd);
+    return 0;
+}
+
+/* Returns 1 if some client already has a complete command buffered, main loop must not block then */
+static int control_pending(void){
+    int i;
+    for(i = 0; i < CONTROL_MAX_CLIENTS; i++)
+        if(clients[i].fd >= 0 && memchr(clients[i].in, '\n', clients[i].in_len) != NULL)
+            return 1;
+    return 0;
+}
+
+/*
+    Fills poll descriptors for the listening socket and all clients.
+    Returns number of descriptors, or negative count when buffered commands are waiting
+    (caller should poll with zero timeout).
+*/
+int control_fill_pollfds(struct pollfd* fds){
+    int n = 0;
+    int i;
+
+    if(listen_fd < 0)
+        return 0;
+    fds[n].fd = listen_fd;
+    fds[n].events = POLLIN;
+    n++;
+    for(i = 0; i < CONTROL_MAX_CLIENTS; i++){
+        if(clients[i].fd < 0)
+            continue;
+        fds[n].fd = clients[i].fd;
+        fds[n].events = POLLIN;
+        n++;
+    }
+    return control_pending() ? -n : n;
+}
+
+static void client_close(struct client* c){
+    close(c->fd);
+    c->fd = -1;
+    c->in_len = 0;
+    c->out_len = 0;
+}
+
+static void client_accept(void){
+    int fd, i;
+
+    while((fd = accept(listen_fd, NULL, NULL)) >= 0){
+        for(i = 0; i < CONTROL_MAX_CLIENTS; i++)
+            if(clients[i].fd < 0)
+                break;
+        if(i == CONTROL_MAX_CLIENTS){
+            send(fd, "ERR too many clients\n", 21, MSG_NOSIGNAL);
+            close(fd);
+            continue;
+        }
+        set_nonblock(fd);
+        clients[i].fd = fd;
+        clients[i].in_len = 0;
+        clients[i].out_len = 0;
+    }
+}
+
+/* Reads whatever the client has sent into its line buffer */
+static void client_read(struct client* c){
+    ssize_t r;
+
+    if(c->in_len == CLIENT_BUF_LEN && memchr(c->in, '\n', c->in_len) == NULL){
+        /* Garbage without newline, drop it */
+        c->in_len = 0;
+        send(c->fd, "ERR line too long\n", 18, MSG_NOSIGNAL);
+    }
+    r = recv(c->fd, c->in + c->in_len, CLIENT_BUF_LEN - c->in_len, 0);
+    if(r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        client_close(c);
+    else if(r > 0)
+        c->in_len += r;
+}
+
+/* Executes one buffered line of the client, returns 1 if a command was executed */
+static int client_exec_one(struct client* c, control_exec_fn exec){
+    char line[CONTROL_LINE_LEN];
+    char reply[CONTROL_REPLY_LEN];
+    char* nl;
+    size_t len;
+    int r;
+
+    nl = memchr(c->in, '\n', c->in_len);
+    if(nl == NULL)
+        return 0;
+    len = nl - c->in;
+    if(len >= CONTROL_LINE_LEN)
+        len = CONTROL_LINE_LEN - 1;
+    memcpy(line, c->in, len);
+    line[len] = '\0';
+    if(len > 0 && line[len - 1] == '\r')
+        line[len - 1] = '\0';
+
+    c->in_len -= (nl + 1) - c->in;
+    memmove(c->in, nl + 1, c->in_len);
+
+    exec(line, reply, sizeof(reply));
+    r = snprintf(c->out + c->out_len, sizeof(c->out) - c->out_len, "%s\n", reply);
+    if(r > 0 && (size_t)r < sizeof(c->out) - c->out_len)
+        c->out_len += r;
+    return 1;
+}
+
+/* Handles poll results: accepts clients, reads commands, executes one bounded batch and replies */
+void control_handle(const struct pollfd* fds, int n, control_exec_fn exec){
+    uint64_t start = now_us();
+    int executed = 0;
+    int progress = 1;
+    int i, k;
+
+    control_batch_us = start;
+    if(n < 0)
+        n = -n;
+    for(k = 0; k < n; k++){
+        if(!(fds[k].revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
+        if(fds[k].fd == listen_fd){
+            client_accept();
+            continue;
+        }
+        for(i = 0; i < CONTROL_MAX_CLIENTS; i++)
+            if(clients[i].fd == fds[k].fd)
+                client_read(&clients[i]);
+    }
+
+    /* Round robin over clients so one client cannot use the whole batch */
+    while(executed < CONTROL_MAX_BATCH && progress){
+        progress = 0;
+        for(i = 0; i < CONTROL_MAX_CLIENTS && executed < CONTROL_MAX_BATCH; i++){
+            if(clients[i].fd < 0)
+                continue;
+            if(client_exec_one(&clients[i], exec)){
+                executed++;
+                progress = 1;
+            }
+        }
+    }
+
+    for(i = 0; i < CONTROL_MAX_CLIENTS; i++){
+        if(clients[i].fd < 0 || clients[i].out_len == 0)
+            continue;
+        if(send(clients[i].fd, clients[i].out, clients[i].out_len, MSG_NOSIGNAL) < 0)
+            client_close(&clients[i]);
+        else
+            clients[i].out_len = 0;
+    }
+
+    if(executed > 0)
+        metrics_observe(H_CONTROL_LATENCY, now_us() - start);
+}
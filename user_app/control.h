@@ -0,0 +1,25 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <poll.h>
+
+#define CONTROL_SOCKET "/tmp/ramp_control.sock" /* Default path of operator control socket */
+#define CONTROL_MAX_CLIENTS 8   /* Simultaneously connected operators / site controllers */
+#define CONTROL_MAX_BATCH 32    /* Commands executed per loop iteration, rest waits for the next one */
+#define CONTROL_LINE_LEN 128    /* Longest accepted command line */
+#define CONTROL_REPLY_LEN 256   /* Longest reply line */
+#define CONTROL_MAX_FDS (CONTROL_MAX_CLIENTS + 1)
+
+/* Executes one command line and fills reply (without newline), implemented by the controller */
+typedef void (*control_exec_fn)(const char* cmd, char* reply, size_t len);
+
+/* Wakeup time of the command batch being executed, for response times measured by the controller */
+extern uint64_t control_batch_us;
+
+int control_open(const char* path);
+int control_fill_pollfds(struct pollfd* fds);
+void control_handle(const struct pollfd* fds, int n, control_exec_fn exec);
+
+#endif
@@ -0,0 +1,216 @@
+#include <string.h>
+#include "cycle.h"
+#include "predict.h"
+
+static uint64_t now(const struct cycle* c){
+    return c->ops->now(c->ctx);
+}
+
+static void lock(struct cycle* c, const char* who){
+    if(c->ops->lock != NULL)
+        c->ops->lock(c->ctx, who);
+}
+
+static void unlock(struct cycle* c, const char* who){
+    if(c->ops->unlock != NULL)
+        c->ops->unlock(c->ctx, who);
+}
+
+static void event(struct cycle* c, enum cycle_event ev, uint64_t arg){
+    if(c->ops->event != NULL)
+        c->ops->event(c->ctx, ev, arg);
+}
+
+/* Sets up a cycle at step 0 with the timing of ramp_app, phase lengths are left to the caller */
+void cycle_init(struct cycle* c, const struct cycle_ops* ops, void* ctx){
+    memset(c, 0, sizeof(*c));
+    c->ops = ops;
+    c->ctx = ctx;
+    c->debounce_us = CLEAR_DEBOUNCE_MS * 1000ULL;
+    c->retry_us = CYCLE_RETRY_US;
+}
+
+/* Returns 1 while a detection hold is in progress, also when the hold was resumed from a previous instance */
+int cycle_held(const struct cycle* c){
+    return now(c) < c->hold_until_us;
+}
+
+/* Returns 1 while the boom must not be lowered: a vehicle is on the loop or predicted to reach the sensor */
+int cycle_approaching(const struct cycle* c){
+    return c->loop_occupied || now(c) < c->approach_until_us;
+}
+
+/*
+    Returns 1 if the boom may be lowered on operator request: no detection is pending or held, the induction
+    loop is free and no vehicle is predicted to reach the sensor.
+*/
+int cycle_may_close(const struct cycle* c){
+    return c->flag == 0 && !cycle_held(c) && !cycle_approaching(c);
+}
+
+/* Records a boom move command, must be called with the lock held */
+void cycle_boom_moved(struct cycle* c, int up){
+    c->boom_up = up;
+    c->boom_moved_us = now(c);
+}
+
+/*
+    Starts given step of the phase cycle. If a detection happened in the meantime the cycle restarts from RED,
+    also when it comes while the step is being entered. A step that falls into a detection hold, that would lower
+    the boom in front of an approaching vehicle or that the actuators are busy for is retried after retry_us,
+    so the caller never blocks on the sensor side. Returns 0 once the step is shown, -1 if it is retried.
+*/
+int cycle_enter(struct cycle* c, int step){
+    if(c->flag > 0){
+        event(c, CYCLE_EV_DROPPED, step);
+        c->flag = 0;
+        step = 0;
+    }
+    c->step = step;
+    while(1){
+        if(cycle_held(c) || (cycle_phase[c->step] == PHASE_RED && cycle_approaching(c)) ||
+           c->ops->enter(c->ctx, c->step) < 0){
+            c->retry = 1;
+            c->deadline_us = now(c) + c->retry_us;
+            return -1;
+        }
+        if(c->flag == 0)
+            break;
+        c->flag = 0;
+        c->step = 0;
+    }
+    c->retry = 0;
+    c->deadline_us = now(c) + c->phase_us[cycle_phase[c->step]];
+    event(c, CYCLE_EV_CHANGED, 0);
+    return 0;
+}
+
+/* Moves on once the deadline of the current step passed: a retried step is tried again, else the next one */
+void cycle_advance(struct cycle* c){
+    uint64_t wait;
+
+    if(c->retry){
+        cycle_enter(c, c->step);
+        return;
+    }
+    if(c->ops->wait != NULL && (wait = c->ops->wait(c->ctx, c->step)) > 0){
+        c->deadline_us = now(c) + wait;
+        return;
+    }
+    cycle_enter(c, (c->step + 1) % CYCLE_STEPS);
+}
+
+/*
+    Continues the cycle after a detection hold ended early. The boom is up after a detection, so GREEN and the
+    YELLOW after it go on for the time they had left, any other step restarts the cycle from RED now rather than
+    at its end. With resume_from_start the step gets its full length instead.
+*/
+void cycle_resume(struct cycle* c){
+    uint64_t deadline = c->deadline_us;
+    int prev = (c->step + CYCLE_STEPS - 1) % CYCLE_STEPS;
+
+    if(c->flag == 0)
+        return;
+    if(!c->retry && deadline > now(c) &&
+       (cycle_phase[c->step] == PHASE_GREEN || cycle_phase[prev] == PHASE_GREEN)){
+        c->flag = 0;
+        if(cycle_enter(c, c->step) == 0 && !c->resume_from_start){
+            c->deadline_us = deadline;
+            event(c, CYCLE_EV_CHANGED, 0);
+        }
+        return;
+    }
+    cycle_enter(c, 0);
+}
+
+/* Raises the boom after a detection and starts the hold, must be called with the lock held */
+static void detect(struct cycle* c, uint64_t t){
+    c->ops->detected(c->ctx, t);
+    c->flag = 1;
+    c->hold_until_us = t + c->hold_us;
+    c->clear_since_us = 0;
+    event(c, CYCLE_EV_CHANGED, 0);
+}
+
+/* Keeps a detection hold running for hold_us after a sample that still sees the vehicle */
+static void extend_hold(struct cycle* c, uint64_t t){
+    uint64_t until = t + c->hold_us;
+
+    lock(c, "extend");
+        if(c->hold_until_us > t && c->hold_until_us < until){
+            c->hold_until_us = until;
+            event(c, CYCLE_EV_CHANGED, 0);
+        }
+    unlock(c, "extend");
+}
+
+/* Ends the detection hold at t and reports the lane time saved */
+static void release_hold(struct cycle* c, uint64_t t){
+    uint64_t saved;
+
+    lock(c, "release");
+        if(c->hold_until_us <= t){
+            unlock(c, "release");
+            return;
+        }
+        saved = c->hold_until_us - t;
+        c->hold_until_us = t;
+        event(c, CYCLE_EV_CHANGED, 0);
+    unlock(c, "release");
+    event(c, CYCLE_EV_RELEASED, saved);
+}
+
+/*
+    Watches the lane during a detection hold. The hold ends early once samples stayed beyond the threshold plus
+    RELEASE_MARGIN_MM for debounce_us without a break, the induction loop is free and the boom had time to get
+    fully up.
+*/
+static void track_clear(struct cycle* c, uint64_t t, unsigned mm, unsigned threshold_mm){
+    if(c->debounce_us == 0)
+        return;
+    if(mm <= threshold_mm + RELEASE_MARGIN_MM || c->loop_occupied){
+        c->clear_since_us = 0;
+        return;
+    }
+    if(c->clear_since_us == 0)
+        c->clear_since_us = t;
+    if(t - c->clear_since_us >= c->debounce_us && t >= c->boom_moved_us + BOOM_TRAVEL_US)
+        release_hold(c, t);
+}
+
+/*
+    Runs the detection rules on one sample taken at t. During a detection hold the boom is already up: a sample
+    that still sees the vehicle extends the hold, the others are watched for the lane to clear. Outside a hold a
+    sample within the threshold is a detection.
+*/
+void cycle_sample(struct cycle* c, uint64_t t, unsigned mm, unsigned threshold_mm){
+    if(cycle_held(c)){
+        if(mm <= threshold_mm)
+            extend_hold(c, t);
+        track_clear(c, t, mm, threshold_mm);
+    }
+    else if(mm <= threshold_mm){
+        lock(c, "sensor");
+            detect(c, t);
+        unlock(c, "sensor");
+    }
+}
+
+/* Reverses a boom lowering still in progress, which restarts the cycle from RED the same way a detection does */
+void cycle_reverse(struct cycle* c){
+    if(c->boom_up || now(c) - c->boom_moved_us >= BOOM_TRAVEL_US)
+        return;
+    lock(c, "reverse");
+        if(!c->boom_up){
+            c->ops->reverse(c->ctx);
+            c->flag = 1;
+            event(c, CYCLE_EV_CHANGED, 0);
+        }
+    unlock(c, "reverse");
+}
+
+/* Reacts to a predicted obstruction: boom lowering is postponed, and a lowering already in progress is reversed */
+void cycle_approach(struct cycle* c){
+    c->approach_until_us = now(c) + 2 * PREDICT_HORIZON_MS * 1000ULL;
+    cycle_reverse(c);
+}
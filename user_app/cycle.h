@@ -0,0 +1,68 @@
+#ifndef CYCLE_H
+#define CYCLE_H
+
+#include <stdint.h>
+#include "ramp.h"
+
+/*
+    Rules of the phase cycle and the detection hold, shared by ramp_app and tools/ramp_sim.c so the simulator
+    runs the controller's own decisions: a detection raises the boom and holds the actuators, every occupied
+    sample extends the hold, a lane that stays clear ends it early, a step due during the hold or one that would
+    lower the boom in front of an approaching vehicle is retried, and the cycle restarts from RED after a
+    detection. The caller owns the struct cycle and supplies time, actuators and locking through cycle_ops;
+    ramp_app takes its control mutex in the lock hooks, the simulator leaves them NULL. Times are us.
+*/
+#define CYCLE_RETRY_US 10000        /* Retry period of a step that could not be entered */
+
+enum cycle_event {
+    CYCLE_EV_CHANGED = 0,           /* State worth saving changed */
+    CYCLE_EV_DROPPED,               /* A step was not shown because a detection restarts the cycle */
+    CYCLE_EV_RELEASED               /* Detection hold ended early, arg is the lane time saved */
+};
+
+struct cycle_ops {
+    uint64_t (*now)(void* ctx);
+    void (*lock)(void* ctx, const char* who);   /* Optional, serializes the sensor side with the cycle */
+    void (*unlock)(void* ctx, const char* who);
+    int (*enter)(void* ctx, int step);          /* Shows a step on the actuators, -1 if they are busy */
+    void (*detected)(void* ctx, uint64_t t);    /* Boom up, buzzer and lights off after a detection, locked */
+    void (*reverse)(void* ctx);                 /* Boom up again while it is being lowered, locked */
+    uint64_t (*wait)(void* ctx, int step);      /* Optional, time to stay in a finished step, 0 to go on */
+    void (*event)(void* ctx, enum cycle_event ev, uint64_t arg);  /* Optional */
+};
+
+struct cycle {
+    const struct cycle_ops* ops;
+    void* ctx;
+    /* Timing, set by the caller */
+    uint64_t phase_us[PHASE_COUNT]; /* Length of each phase */
+    uint64_t hold_us;               /* Detection hold after the last occupied sample */
+    uint64_t debounce_us;           /* Lane clear time that ends a hold early, 0 keeps the full hold */
+    uint64_t retry_us;
+    int resume_from_start;          /* Steps can only be entered from their start, a resumed one gets its full length */
+    /* State */
+    int step;                       /* Index into cycle_phase */
+    int retry;                      /* Current step could not be entered yet */
+    int flag;                       /* Detection since the step was entered, the cycle restarts from RED */
+    uint64_t deadline_us;           /* End of the current step */
+    uint64_t hold_until_us;         /* End of the detection hold, actuators are not commanded before this time */
+    uint64_t clear_since_us;        /* First sample of the current clear run during a hold, 0 if none */
+    volatile uint64_t approach_until_us;  /* Boom is not lowered before this time */
+    volatile int loop_occupied;     /* Induction loop under the boom occupied, boom is not lowered */
+    int boom_up;
+    uint64_t boom_moved_us;         /* Time of the last boom move command */
+};
+
+void cycle_init(struct cycle* c, const struct cycle_ops* ops, void* ctx);
+int cycle_held(const struct cycle* c);
+int cycle_approaching(const struct cycle* c);
+int cycle_may_close(const struct cycle* c);
+int cycle_enter(struct cycle* c, int step);
+void cycle_advance(struct cycle* c);
+void cycle_resume(struct cycle* c);
+void cycle_sample(struct cycle* c, uint64_t t, unsigned mm, unsigned threshold_mm);
+void cycle_approach(struct cycle* c);
+void cycle_reverse(struct cycle* c);
+void cycle_boom_moved(struct cycle* c, int up);
+
+#endif
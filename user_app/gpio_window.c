@@ -0,0 +1,23 @@
+#include <string.h>
+#include <sys/mman.h>
+#include "gpio_window.h"
+
+/* Maps GPIO register page exported by led_driver, returns 0 on success */
+int gpio_window_open(struct gpio_window* w, int led_fd){
+    memset(w, 0, sizeof(*w));
+    w->base = mmap(NULL, GPIO_WINDOW_LEN, PROT_READ | PROT_WRITE, MAP_SHARED, led_fd, 0);
+    if(w->base == MAP_FAILED){
+        w->base = NULL;
+        return -1;
+    }
+    w->set = (volatile uint32_t*)((char*)w->base + GPSET0_OFFSET);
+    w->clr = (volatile uint32_t*)((char*)w->base + GPCLR0_OFFSET);
+    w->lev = (volatile uint32_t*)((char*)w->base + GPLEV0_OFFSET);
+    return 0;
+}
+
+void gpio_window_close(struct gpio_window* w){
+    if(w->base != NULL)
+        munmap(w->base, GPIO_WINDOW_LEN);
+    w->base = NULL;
+}
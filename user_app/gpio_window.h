@@ -0,0 +1,43 @@
+#ifndef GPIO_WINDOW_H
+#define GPIO_WINDOW_H
+
+#include <stdint.h>
+
+/*
+    Direct access to the BCM GPIO registers through led_driver's mmap, light changes and level
+    reads become plain stores and loads. Only GPSET0, GPCLR0 and GPLEV0 are used, offsets match
+    the definitions in led_driver.c. Mapping requires CAP_SYS_RAWIO.
+*/
+#define GPIO_WINDOW_LEN 4096
+#define GPSET0_OFFSET (0x1C)
+#define GPCLR0_OFFSET (0x28)
+#define GPLEV0_OFFSET (0x34)
+
+/* LED pins, see pinovi.txt */
+#define GPIO_LED_RED    (5)
+#define GPIO_LED_YELLOW (6)
+#define GPIO_LED_GREEN  (26)
+#define GPIO_LED_MASK   ((1u << GPIO_LED_RED) | (1u << GPIO_LED_YELLOW) | (1u << GPIO_LED_GREEN))
+
+struct gpio_window {
+    volatile uint32_t* set;
+    volatile uint32_t* clr;
+    volatile uint32_t* lev;
+    void* base;
+};
+
+int gpio_window_open(struct gpio_window* w, int led_fd);
+void gpio_window_close(struct gpio_window* w);
+
+/* Turns on LEDs in mask (GPIO_LED_* bits) and turns off the other semaphore LEDs */
+static inline void gpio_window_lights(struct gpio_window* w, uint32_t mask){
+    *w->clr = GPIO_LED_MASK & ~mask;
+    *w->set = mask;
+}
+
+/* Returns levels of GPIO pins 0-31 */
+static inline uint32_t gpio_window_levels(struct gpio_window* w){
+    return *w->lev;
+}
+
+#endif
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "ramp.h"
+#include "handoff.h"
+
+#define STATE_MAGIC 0x52415354 /* "RAST" */
+#define BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+
+static void read_boot_id(char* id, size_t len){
+    int fd = open(BOOT_ID_PATH, O_RDONLY);
+    ssize_t r = -1;
+
+    memset(id, 0, len);
+    if(fd >= 0){
+        r = read(fd, id, len - 1);
+        close(fd);
+    }
+    if(r > 0 && id[r - 1] == '\n')
+        id[r - 1] = '\0';
+}
+
+/*
+    Writes state to a temporary file and renames it over the old one, so a reader never sees half a state.
+    Only the main loop saves (state_flush of main.c), the temporary file needs no lock.
+*/
+int state_save(const char* path, struct ramp_state* st){
+    char tmp[256];
+    int fd, ok;
+
+    st->magic = STATE_MAGIC;
+    st->saved_us = now_us();
+    read_boot_id(st->boot_id, sizeof(st->boot_id));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ok = fd >= 0 && write(fd, st, sizeof(*st)) == sizeof(*st);
+    if(fd >= 0)
+        close(fd);
+    ok = ok && rename(tmp, path) == 0;
+    return ok ? 0 : -1;
+}
+
+/* Loads state saved during this boot, returns 0 on success */
+int state_load(const char* path, struct ramp_state* st){
+    char boot_id[sizeof(st->boot_id)];
+    int fd = open(path, O_RDONLY);
+    ssize_t r;
+
+    if(fd < 0)
+        return -1;
+    r = read(fd, st, sizeof(*st));
+    close(fd);
+    if(r != sizeof(*st) || st->magic != STATE_MAGIC)
+        return -1;
+    read_boot_id(boot_id, sizeof(boot_id));
+    if(strcmp(boot_id, st->boot_id) != 0 || st->saved_us > now_us())
+        return -1;
+    return 0;
+}
+
+/* Takes a snapshot of the driver status page, returns -1 if ramp_status is not loaded */
+int status_page_read(struct ramp_status* st){
+    const volatile struct ramp_status* page;
+    long page_len = sysconf(_SC_PAGESIZE);
+    int fd = open(RAMP_STATUS_DEVICE, O_RDONLY);
+
+    if(fd < 0)
+        return -1;
+    page = mmap(NULL, page_len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(page == MAP_FAILED)
+        return -1;
+    ramp_status_read(page, st);
+    munmap((void*)page, page_len);
+    return st->magic == RAMP_STATUS_MAGIC ? 0 : -1;
+}
+
+/*
+    Asks the instance listening on the control socket to save its state and exit, and waits until it is gone
+    (its end of the connection is closed). Returns 0 when there was no instance or it handed over,
+    -1 if it refused or did not exit in time.
+*/
+int handoff_request(const char* control_path){
+    struct sockaddr_un addr;
+    struct pollfd pfd;
+    char reply[64];
+    uint64_t until_ms = now_ms() + HANDOFF_WAIT_MS;
+    size_t got = 0;
+    ssize_t r = -1;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, control_path, sizeof(addr.sun_path) - 1);
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+        close(fd);
+        return 0;
+    }
+    if(send(fd, "handoff\n", 8, MSG_NOSIGNAL) != 8){
+        close(fd);
+        return -1;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while(now_ms() < until_ms){
+        if(poll(&pfd, 1, (int)(until_ms - now_ms())) <= 0)
+            continue;
+        r = recv(fd, reply + got, sizeof(reply) - 1 - got, 0);
+        if(r <= 0)
+            break;
+        got += r;
+        if(got == sizeof(reply) - 1)
+            got = 0;
+    }
+    close(fd);
+    reply[got] = '\0';
+    return r == 0 && strncmp(reply, "OK", 2) == 0 ? 0 : -1;
+}
@@ -0,0 +1,37 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdint.h>
+#include "../drivers/ramp_status.h"
+
+/*
+    Controller state kept across restarts. The state is saved on every phase change and detection,
+    and when a new instance takes over with the "handoff" control command. On start the controller resumes from
+    the saved state, or from the driver status page when no usable state is saved, so a restart never
+    moves the boom on its own. All times are CLOCK_MONOTONIC, valid across processes of one boot.
+*/
+#define STATE_FILE "/tmp/ramp_app.state"   /* Default path of saved state */
+#define HANDOFF_WAIT_MS 1000               /* Longest wait for the old instance to hand over */
+
+struct ramp_state {
+    uint32_t magic;
+    char boot_id[40];        /* Saved state of a previous boot is not used */
+    uint64_t saved_us;
+    int32_t phase;
+    int32_t boom_up;
+    uint64_t boom_moved_us;
+    int32_t mode;
+    int32_t cycle_step;
+    int32_t step_retry;
+    int32_t flag;            /* Detection in progress */
+    uint64_t deadline_us;    /* End of current step */
+    uint64_t remaining_us;   /* Time left in a held step */
+    uint64_t hold_until_us;  /* End of detection hold */
+};
+
+int state_save(const char* path, struct ramp_state* st);
+int state_load(const char* path, struct ramp_state* st);
+int status_page_read(struct ramp_status* st);
+int handoff_request(const char* control_path);
+
+#endif
@@ -6,6 +6,29 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/eventfd.h>
+#include "ramp.h"
+#include "passage.h"
+#include "metrics.h"
+#include "control.h"
+#include "trace.h"
+#include "watchdog.h"
+#include "gpio_window.h"
+#include "uring_io.h"
+#include "predict.h"
+#include "calib.h"
+#include "baseline.h"
+#include "handoff.h"
+#include "site.h"
+#include "pair.h"
+#include "probes.h"
+#include "cycle.h"
+#include "../drivers/gpio_input.h"
+#include "../drivers/ramp_seq.h"
 
 #define BUF_LEN 10 /* Char buffer length holding messages for LED drvier */
 
@@ -30,112 +53,1488 @@ const int RED_SLEEP = 5;
 const int YELLOW_SLEEP = 2;
 const int GREEN_SLEEP = 4;  
 
+#define CONTROL_LOCK_TIMEOUT_MS 100 /* Longest time an operator command waits for the actuators */
+#define OPEN_WAIT_MS 2000           /* Time device files may take to appear after the drivers are loaded */
+#define ADC_ACTIVE_PERIOD_US 2000   /* adc_driver active_period_us, also the retry delay after a failed read */
+#define ADC_IDLE_PERIOD_US 100000   /* adc_driver idle_period_us */
+
 /* File descriptors for all driver files after opening */
 int led_fd, pwm_fd, buzz_fd, adc_fd;
 
-/* Flag to indicate when sensor has detected an object, used to restart the semaphore */
-char flag = 0x00;
+/* Currently shown phase, written under mtx */
+volatile int current_phase = PHASE_RED;
+uint64_t phase_since_us;   /* Time the current phase was shown */
 
-/* SIGINT handler function, closes driver files */
-void kill_handler(int signo, siginfo_t *info, void *context){
-    if(signo==SIGINT){
-        close(led_fd);
-        close(pwm_fd);
-        close(buzz_fd);
-        close(adc_fd);
-        exit(1);
-    }
+/* ADC sampling mode, 1 when adc_driver samples slowly with converter power-down, -1 until first set */
+static pthread_mutex_t rate_mtx = PTHREAD_MUTEX_INITIALIZER;
+int sampling_idle = -1;
+
+/* Main loop mode, changed by operator commands */
+enum { MODE_CYCLE, MODE_HOLD, MODE_FORCED, MODE_FAILSAFE, MODE_PRIORITY } mode = MODE_CYCLE;
+uint64_t remaining_us;     /* Time left in the step when cycle was put on hold */
+
+/* Deadline accounting of sensor and main loops */
+struct loop_monitor sensor_mon;
+struct loop_monitor cycle_mon;
+uint64_t last_kick_us;
+
+/* GPIO registers mapped from led_driver, lights are set without syscalls when open */
+struct gpio_window gpio_win;
+
+/* Optional io_uring backend: actuator commands are batched per decision, ADC reads carry a linked timeout */
+enum { URING_LED, URING_PWM, URING_BUZZ };
+int use_uring = 0;
+struct uring_io act_ring;  /* Actuator writes, used under mtx */
+struct uring_io adc_ring;  /* ADC reads, used only by the sensor thread */
+
+/* Trace capture and replay */
+struct trace capture;      /* Open when sensor samples are being recorded */
+FILE* replay_log = NULL;   /* Actuator command sequence output while replaying */
+uint64_t replay_start_us;
+
+/*
+    Phase cycle, detection hold and boom position, run by the rules in cycle.c that ramp_sim shares. State is
+    changed under mtx, except step, retry and deadline_us which only the main loop touches.
+*/
+struct cycle cyc;
+
+/* Early end of the detection hold once the lane is clear */
+volatile int hold_released = 0;    /* Set by the sensor thread, the main loop resumes the cycle */
+unsigned long early_releases;
+uint64_t hold_saved_us;            /* Lane time given back by early releases */
+
+/* State kept across restarts, see handoff.h */
+const char* state_path = NULL;     /* Not saved while replaying */
+pthread_mutex_t state_mtx = PTHREAD_MUTEX_INITIALIZER;  /* Guards the snapshot below, never held across file I/O */
+struct ramp_state state_snap;      /* Latest state, written to state_path by the main loop */
+int state_dirty = 0;
+volatile int handoff_requested = 0;
+uint64_t handoff_until_ms;         /* A handoff the actuators keep blocking is refused after this */
+volatile sig_atomic_t stop_requested = 0;  /* SIGINT received, the main loop shuts down */
+
+/* Approach prediction from sensor trend, optional */
+int use_predict = 0;
+struct predictor approach;
+
+/* Discrete inputs of led_driver, by index in its input_pins parameter, optional */
+#define INPUT_LOOP 0               /* Induction loop under the boom, active while a vehicle is on it */
+#define INPUT_ESTOP 1              /* Emergency stop, active while pressed */
+#define INPUT_DEMAND 2             /* Presence loop at the stop line, active while a vehicle waits */
+#define INPUT_PRIORITY 3           /* Emergency vehicle preemption, active while the ramp must stay open */
+int input_fd = -1;
+int estop = 0;                     /* Safe state is kept while set */
+int failsafe_pending = 0;          /* Safe state entered, actuators not driven to it yet */
+volatile int vehicle_waiting = 0;
+
+/* Lot occupancy shared with the other ramps of the site, optional */
+#define SITE_RETRY_MS 1000         /* Period of attach attempts while the aggregator is not running */
+#define SITE_RECHECK_US 1000000    /* RED is extended by this long while the lot is full */
+struct site site;
+int site_lane = -1;                /* Lane number, -1 when the ramp is not part of a site */
+enum site_dir site_dir;
+uint64_t site_retry_ms;
+
+/* Single-lane passage shared with the other ramps of a group, optional, see pair.h */
+struct pair pair;
+int pair_lane = -1;                /* Ramp number in the group, -1 when the passage is not shared */
+int pair_acquired = 0;             /* Grant taken at the end of RED, reported open until RED is left */
+uint64_t pair_retry_ms;
+
+/* Priority open of the ramp for emergency vehicles, see priority_open */
+#define PRIO_INPUT 1               /* Source: priority input active */
+#define PRIO_LATCHED 2             /* Source: "priority-open" command or SIGUSR1, until "resume" or SIGUSR2 */
+int priority_src = 0;              /* Active sources, the ramp stays open while any is set */
+int priority_efd = -1;             /* Signalled by priority_handler to wake the main loop */
+volatile sig_atomic_t priority_signal = 0;  /* Last priority signal, 1 open, -1 release, 0 handled */
+int priority_waiting = 0;          /* Priority open requested, the shared passage is not granted yet */
+uint64_t priority_req_us;          /* Time of the request a waiting priority open is measured from, 0 for none */
+volatile uint64_t priority_signal_us;       /* Time the last priority signal arrived */
+
+/* Kernel phase sequencer, optional: ramp_seq runs the cycle on hrtimers and the main loop only supervises it */
+int seq_fd = -1;
+volatile int seq_running = 0;      /* Sequencer was started and not stopped since */
+int seq_held = 0;                  /* Held by the supervisor, not by the operator */
+#define SEQ_PREHOLD_US 300000      /* Step ends that need a decision are held this long before the sequencer reaches them */
+
+/* Empty lane baseline and the detection threshold derived from it, updated by the sensor thread */
+struct baseline ambient;
+volatile unsigned threshold_mm = SENSOR_THRESHOLD_MM;
+
+/* Passage detector fed by the sensor thread and throughput counters */
+struct passage_detector detector;
+struct passage_stats stats;
+
+/* Returns local hour of the day, used for per-hour counters */
+static int local_hour(void){
+    time_t t = wall_time();
+    struct tm tm;
+    localtime_r(&t, &tm);
+    return tm.tm_hour;
 }
 
-/* Function that sends a message to LED driver and moves servo in correct direction depending on the message being sent */
-void send_to_drivers(const char* msg){
-    if(flag > 0)
-            return;
+/* Control mutex operations with lock__* probes, who names the caller in traces */
+static void ctl_lock(const char* who){
+    RAMP_PROBE1(lock__wait, who);
     pthread_mutex_lock(&mtx);
-        write(led_fd, msg, BUF_LEN);
+    RAMP_PROBE1(lock__acquired, who);
+}
+
+static int ctl_trylock(const char* who){
+    if(pthread_mutex_trylock(&mtx) != 0){
+        RAMP_PROBE1(lock__busy, who);
+        return -1;
+    }
+    RAMP_PROBE1(lock__acquired, who);
+    return 0;
+}
+
+/* Waits at most timeout_ms for the control mutex, returns -1 if it stays busy */
+static int ctl_timedlock(const char* who, int timeout_ms){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += timeout_ms * 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    RAMP_PROBE1(lock__wait, who);
+    if(pthread_mutex_timedlock(&mtx, &ts) != 0){
+        RAMP_PROBE1(lock__busy, who);
+        return -1;
+    }
+    RAMP_PROBE1(lock__acquired, who);
+    return 0;
+}
+
+static void ctl_unlock(const char* who){
+    pthread_mutex_unlock(&mtx);
+    RAMP_PROBE1(lock__release, who);
+}
+
+/* Records an actuator command in the capture next to the sensor samples, never writes the file itself */
+static void capture_event(int ev){
+    struct trace_record rec;
+
+    if(capture.f == NULL)
+        return;
+    memset(&rec, 0, sizeof(rec));
+    rec.t_us = now_us();
+    rec.event = ev;
+    trace_write(&capture, &rec);
+}
+
+/* Returns the trace event of a LED driver message */
+static int lights_event(const char* msg){
+    if(strcmp(RED,msg) == 0)
+        return TRACE_EV_RED;
+    if(strcmp(YELLOW,msg) == 0)
+        return TRACE_EV_YELLOW;
+    if(strcmp(GREEN,msg) == 0)
+        return TRACE_EV_GREEN;
+    return TRACE_EV_LIGHTS_OFF;
+}
+
+/* Writes a command to one of the actuator drivers, counting the syscall, and records it once issued */
+static ssize_t actuate(int fd, const char* msg, size_t len){
+    uint64_t t;
+    ssize_t r;
+
+    if(replay_log != NULL){
+        t = now_us() - replay_start_us;
+        fprintf(replay_log, "%llu.%06llu %s %s\n", (unsigned long long)(t / 1000000), (unsigned long long)(t % 1000000),
+                fd == led_fd ? "led" : fd == pwm_fd ? "pwm" : "buzz", msg[0] ? msg : "OFF");
+    }
+    if(use_uring)
+        r = uring_io_write(&act_ring, fd == led_fd ? URING_LED : fd == pwm_fd ? URING_PWM : URING_BUZZ, msg, len);
+    else{
+        metrics_inc(M_ACTUATOR_SYSCALLS);
+        r = write(fd, msg, len);
+    }
+
+    if(fd == pwm_fd)
+        capture_event(strcmp(msg, MOV_UP) == 0 ? TRACE_EV_BOOM_UP : TRACE_EV_BOOM_DOWN);
+    else if(fd == buzz_fd)
+        capture_event(TRACE_EV_BUZZ);
+    return r;
+}
+
+/*
+    Submits actuator commands queued for one decision as a single batch, must be called with mtx held. The
+    commands are independent, each one without a full length result (failed, short, not taken by the kernel
+    or still in flight when submit gave up) is written again with write(), as the blocking path would, so
+    one failing driver never leaves another actuator in its previous state.
+*/
+static void actuators_flush(void){
+    static const int* files[] = { &led_fd, &pwm_fd, &buzz_fd };
+    unsigned long enters = act_ring.enters;
+    unsigned slot;
+
+    if(!use_uring)
+        return;
+    uring_io_submit(&act_ring);
+    for(slot = 0; slot < act_ring.submitted; slot++){
+        if(act_ring.results[slot] == (int)act_ring.lens[slot])
+            continue;
+        metrics_inc(M_ACTUATOR_SYSCALLS);
+        if(write(*files[act_ring.files[slot]], act_ring.bufs[slot], act_ring.lens[slot]) != (ssize_t)act_ring.lens[slot])
+            perror("WARNING: Actuator command failed");
+    }
+    for(; enters < act_ring.enters; enters++)
+        metrics_inc(M_ACTUATOR_SYSCALLS);
+}
+
+/* Shows a LED driver message on the semaphore, through the mapped GPIO window if available */
+static void set_lights(const char* msg){
+    uint32_t mask = 0;
+
+    if(gpio_win.base == NULL){
+        actuate(led_fd, msg, msg[0] ? BUF_LEN : 1);
+    }
+    else{
         if(strcmp(RED,msg) == 0)
-            write(pwm_fd, MOV_DOWN, strlen(MOV_DOWN));
+            mask = 1u << GPIO_LED_RED;
+        else if(strcmp(YELLOW,msg) == 0)
+            mask = 1u << GPIO_LED_YELLOW;
         else if(strcmp(GREEN,msg) == 0)
-            write(pwm_fd, MOV_UP, strlen(MOV_UP));
-    pthread_mutex_unlock(&mtx);
-    return;
+            mask = 1u << GPIO_LED_GREEN;
+        gpio_window_lights(&gpio_win, mask);
+    }
+    capture_event(lights_event(msg));
+}
+
+/*
+    Selects ADC sampling rate from ramp state: high rate while boom is up or moving, or while something is near
+    the sensor, slow sampling with converter power-down when the lane is idle and the boom is down.
+*/
+static void update_sampling(int near){
+    int idle;
+
+    if(clock_virtual)
+        return;
+    pthread_mutex_lock(&rate_mtx);
+        idle = !near && !cyc.boom_up && now_us() - cyc.boom_moved_us > BOOM_TRAVEL_US && detector.state == PD_IDLE;
+        if(idle != sampling_idle){
+            sampling_idle = idle;
+            write(adc_fd, idle ? "IDLE" : "ACTIVE", idle ? 4 : 6);
+        }
+    pthread_mutex_unlock(&rate_mtx);
+}
+
+/* Accounts a boom move and a boom cycle each time it goes up, must be called with mtx held */
+static void boom_moved(int up){
+    if(up && !cyc.boom_up)
+        passage_stats_boom_cycle(&stats, current_phase, local_hour());
+    cycle_boom_moved(&cyc, up);
+    update_sampling(0);
+}
+
+/* Moves the boom, must be called with mtx held */
+static void move_boom(int up){
+    actuate(pwm_fd, up ? MOV_UP : MOV_DOWN, strlen(up ? MOV_UP : MOV_DOWN));
+    boom_moved(up);
+}
+
+/* Writes one command to the kernel sequencer */
+static int seq_command(const char* cmd){
+    if(write(seq_fd, cmd, strlen(cmd)) < 0){
+        fprintf(stderr, "WARNING: Sequencer refused \"%s\": %s\n", cmd, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Stops the kernel sequencer before lights or boom are commanded from here, no-op without it */
+static void seq_stop(void){
+    if(seq_fd < 0 || !seq_running)
+        return;
+    seq_command("stop");
+    seq_running = 0;
+    seq_held = 0;
+}
+
+/*
+    SIGINT handler function, only flags the request. Closing files and printing take locks the interrupted
+    thread may hold, the main loop does it in shut_down within one poll timeout.
+*/
+void kill_handler(int signo, siginfo_t *info, void *context){
+    if(signo==SIGINT)
+        stop_requested = 1;
+}
+
+/* SIGUSR1 / SIGUSR2 handler, requests or releases a priority open, the main loop acts on it */
+void priority_handler(int signo, siginfo_t *info, void *context){
+    struct timespec ts;
+    uint64_t one = 1;
+    int saved_errno = errno;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    priority_signal_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    priority_signal = signo == SIGUSR1 ? 1 : -1;
+    write(priority_efd, &one, sizeof(one));
+    errno = saved_errno;
+}
+
+/* Returns LED driver message for a phase */
+static const char* phase_msg(int phase){
+    if(phase == PHASE_RED)
+        return RED;
+    if(phase == PHASE_GREEN)
+        return GREEN;
+    return YELLOW;
+}
+
+/* Returns duration of a phase in seconds */
+static int phase_seconds(int phase){
+    if(phase == PHASE_RED)
+        return RED_SLEEP;
+    if(phase == PHASE_GREEN)
+        return GREEN_SLEEP;
+    return YELLOW_SLEEP;
+}
+
+/* Loads the phase cycle into the kernel sequencer, lights with the boom lowered at RED and raised at GREEN */
+static int seq_load(void){
+    char cmd[160];
+    int i, len;
+
+    len = snprintf(cmd, sizeof(cmd), "program");
+    for(i = 0; i < CYCLE_STEPS; i++)
+        len += snprintf(cmd + len, sizeof(cmd) - len, " %s:%s:%d", phase_msg(cycle_phase[i]),
+                        cycle_phase[i] == PHASE_RED ? "down" : cycle_phase[i] == PHASE_GREEN ? "up" : "-",
+                        phase_seconds(cycle_phase[i]) * 1000);
+    return seq_command(cmd);
+}
+
+/* Sends a message to LED driver and moves servo in correct direction depending on the message, must be called with mtx held */
+static void apply_phase(const char* msg){
+    uint64_t now = now_us();
+
+    if(phase_since_us != 0)
+        RAMP_PROBE2(phase__exit, current_phase, now - phase_since_us);
+    set_lights(msg);
+    if(strcmp(RED,msg) == 0){
+        current_phase = PHASE_RED;
+        move_boom(0);
+    }
+    else if(strcmp(GREEN,msg) == 0){
+        current_phase = PHASE_GREEN;
+        move_boom(1);
+    }
+    else
+        current_phase = PHASE_YELLOW;
+    actuators_flush();
+    phase_since_us = now;
+    metrics_phase(current_phase);
+    RAMP_PROBE2(phase__enter, current_phase, cyc.step);
+}
+
+/*
+    Saves controller state for a restart or a new instance taking over. Only a snapshot is taken, cheap enough
+    for the sensor thread under the control mutex; the main loop writes the latest one with state_flush.
+*/
+static void save_state(void){
+    struct ramp_state st;
+
+    if(state_path == NULL)
+        return;
+    memset(&st, 0, sizeof(st));
+    st.phase = current_phase;
+    st.boom_up = cyc.boom_up;
+    st.boom_moved_us = cyc.boom_moved_us;
+    st.mode = mode;
+    st.cycle_step = cyc.step;
+    st.step_retry = cyc.retry;
+    st.flag = cyc.flag;
+    st.deadline_us = cyc.deadline_us;
+    st.remaining_us = remaining_us;
+    st.hold_until_us = cyc.hold_until_us;
+    pthread_mutex_lock(&state_mtx);
+    state_snap = st;
+    state_dirty = 1;
+    pthread_mutex_unlock(&state_mtx);
+}
+
+/* Writes the last state snapshot to the state file, main loop only */
+static void state_flush(void){
+    static int warned = 0;
+    struct ramp_state st;
+    int dirty;
+
+    pthread_mutex_lock(&state_mtx);
+    st = state_snap;
+    dirty = state_dirty;
+    state_dirty = 0;
+    pthread_mutex_unlock(&state_mtx);
+    if(dirty && state_save(state_path, &st) < 0 && !warned){
+        perror("WARNING: Failed saving state");
+        warned = 1;
+    }
+}
+
+/*
+    Function that sends a phase message to the drivers. Returns -1 without blocking if the sensor thread
+    currently holds the actuators. Detections, holds and approaching vehicles are left to cycle_enter.
+*/
+int send_to_drivers(const char* msg){
+    RAMP_PROBE1(send__start, msg);
+    if(ctl_trylock("cycle") != 0){
+        RAMP_PROBE2(send__done, msg, -1);
+        return -1;
+    }
+
+    apply_phase(msg);
+    ctl_unlock("cycle");
+    RAMP_PROBE2(send__done, msg, 0);
+    return 0;
+}
+
+/* Opens one device file, waiting up to OPEN_WAIT_MS for it to be created when started together with the drivers */
+static int open_driver(const char* path, uint64_t until_ms){
+    struct timespec ts = { 0, 10000000L };
+    int fd;
+
+    while((fd = open(path, O_RDWR)) < 0 && errno == ENOENT && now_ms() < until_ms)
+        nanosleep(&ts, NULL);
+    return fd;
 }
 
 /* Function that opens all device files and checks for errors */
 int open_drivers(void){
-    led_fd = open(LED_DRIVER, O_RDWR);
-    pwm_fd = open(PWM_DRIVER, O_RDWR);
-    buzz_fd = open(BUZZ_DRIVER, O_RDWR);
-    adc_fd = open(ADC_DRIVER, O_RDWR);
+    uint64_t until_ms = now_ms() + OPEN_WAIT_MS;
+
+    led_fd = open_driver(LED_DRIVER, until_ms);
+    pwm_fd = open_driver(PWM_DRIVER, until_ms);
+    buzz_fd = open_driver(BUZZ_DRIVER, until_ms);
+    adc_fd = open_driver(ADC_DRIVER, until_ms);
     if(led_fd < 0 || pwm_fd < 0 || buzz_fd < 0 || adc_fd < 0)
         return -1;
     return 0;
 }
 
+/* Posts a vehicle that passed the ramp to the site aggregator, never blocks */
+static void site_passage(const struct passage_event* pev){
+    struct site_event ev;
+
+    if(site_lane < 0)
+        return;
+    memset(&ev, 0, sizeof(ev));
+    ev.t_us = now_us();
+    ev.dwell_ms = pev->dwell_ms;
+    ev.lane = site_lane;
+    ev.dir = site_dir;
+    site_post(&site, &ev);
+}
+
+/* Attaches to the site segment once the aggregator has created it */
+static void site_tick(void){
+    if(site_lane < 0 || site.shm != NULL || now_ms() < site_retry_ms)
+        return;
+    site_retry_ms = now_ms() + SITE_RETRY_MS;
+    if(site_open(&site, SITE_SHM, 0) == 0)
+        printf("Joined site as %s lane %d\n", site_dir == SITE_ENTRY ? "entry" : "exit", site_lane);
+}
+
+/* Returns 1 while vehicles wait at or pass through this ramp, PAIR_DEMAND_PRIORITY during a priority open */
+static int pair_demand(void){
+    if(mode == MODE_PRIORITY)
+        return PAIR_DEMAND_PRIORITY;
+    return vehicle_waiting || cycle_approaching(&cyc) || detector.state != PD_IDLE;
+}
+
+/* Returns 1 unless the ramp is at RED with the boom down, the clearance interval covers the lowering */
+static int pair_is_open(void){
+    return pair_acquired || current_phase != PHASE_RED || cyc.boom_up;
+}
+
+static void priority_open(int src, uint64_t t_req);
+
+/* Attaches to the group once its scheduler runs, reports this ramp's state and retries a waiting priority open */
+static void pair_tick(void){
+    if(pair_lane < 0)
+        return;
+    if(pair.shm == NULL){
+        if(now_ms() < pair_retry_ms)
+            return;
+        pair_retry_ms = now_ms() + SITE_RETRY_MS;
+        if(pair_open(&pair, PAIR_SHM, 0, 0) < 0)
+            return;
+        printf("Joined passage group as ramp %d\n", pair_lane);
+    }
+    if(pair_acquired && current_phase != PHASE_RED)
+        pair_acquired = 0;
+    pair_report(&pair, pair_lane, pair_is_open(), pair_demand(), now_us());
+    if(priority_waiting && mode == MODE_PRIORITY)
+        priority_open(0, 0);
+}
+
+/*
+    Takes the grant before the ramp leaves RED. The ramp is reported open before the grant is read, so the
+    scheduler either sees it open or has not withdrawn the grant yet. Without a running scheduler the ramp
+    stays RED, two ramps of a group never open at once. While the grant is elsewhere the ramp is not reported
+    open at all, repeated attempts would restart the clearance of the scheduler.
+*/
+static int pair_may_open(void){
+    if(pair_lane < 0 || pair_acquired)
+        return 1;
+    if(!pair_granted(&pair, pair_lane, now_us()))
+        return 0;
+    pair_acquired = 1;
+    pair_report(&pair, pair_lane, 1, pair_demand(), now_us());
+    if(pair_granted(&pair, pair_lane, now_us()))
+        return 1;
+    pair_acquired = 0;
+    pair_report(&pair, pair_lane, pair_is_open(), pair_demand(), now_us());
+    return 0;
+}
+
+/* Returns 1 while GREEN may go on for vehicles still coming, up to the length the scheduler allows */
+static int pair_extend(void){
+    return pair_lane >= 0 && current_phase == PHASE_GREEN && cyc.flag == 0 && pair_demand() &&
+           now_us() - phase_since_us + PAIR_RECHECK_MS * 1000ULL <= pair_green_ms(&pair) * 1000ULL;
+}
+
+/* Feeds one sample into the passage detector, logs events and updates throughput counters */
+static void track_passage(int occupied){
+    static int last_hour = -1;
+    struct passage_event ev;
+    int hour = local_hour();
+
+    if(last_hour >= 0 && hour != last_hour)
+        passage_stats_print(&stats, stdout);
+    last_hour = hour;
+
+    if(!passage_feed(&detector, occupied, now_ms(), &ev))
+        return;
+    if(ev.type == PASSAGE_ENTER){
+        metrics_inc(M_VEHICLES);
+        printf("Vehicle entered (%s)\n", phase_name(current_phase));
+    }
+    else if(ev.type == PASSAGE_EXIT){
+        printf("Vehicle left after %llu ms\n", (unsigned long long)ev.dwell_ms);
+        site_passage(&ev);
+    }
+    passage_stats_event(&stats, &ev, current_phase, hour);
+}
+
+/* Compares measured distance to threshold, returns 1 if object is close enough to stop the ramp */
+static int sample_occupied(unsigned mm){
+    return mm <= threshold_mm;
+}
+
+/* Feeds the ambient baseline with a sample of an idle lane and applies the adjusted threshold */
+static void track_baseline(uint64_t t_us, unsigned mm){
+    threshold_mm = baseline_feed(&ambient, t_us, mm, detector.state == PD_IDLE && !cycle_approaching(&cyc));
+    approach.threshold_mm = threshold_mm;
+    metrics_set(G_BASELINE_MM, ambient.mean_mm);
+    metrics_set(G_BASELINE_NOISE_MM, sqrt(ambient.var_mm2));
+    metrics_set(G_THRESHOLD_MM, threshold_mm);
+}
+
+/* Returns 1 if object is approaching the sensor, used to speed up sampling */
+static int sample_near(unsigned mm){
+    return mm <= SENSOR_NEAR_MM;
+}
+
+/* Raises the boom, buzzes and turns lights off after a detection, cycle_sample calls it with mtx held */
+static void obstacle_detected(void* ctx, uint64_t t_sample){
+    metrics_inc(M_DETECTIONS);
+    seq_stop();
+    move_boom(1);
+    actuate(buzz_fd, MOV_UP, strlen(MOV_UP));
+    set_lights("");
+    actuators_flush();
+    metrics_observe(H_DETECTION_LATENCY, now_us() - t_sample);
+}
+
+/* Reads one sample from ADC, through io_uring with a linked timeout of one sensor deadline if enabled */
+static int sensor_read(char data[2]){
+    int slot;
+
+    if(!use_uring)
+        return read(adc_fd, data, 2) < 0 ? -1 : 0;
+    slot = uring_io_read(&adc_ring, 0, 2, SENSOR_DEADLINE_US);
+    if(slot < 0 || uring_io_submit(&adc_ring) != 0 || adc_ring.results[slot] != 2)
+        return -1;
+    memcpy(data, adc_ring.bufs[slot], 2);
+    return 0;
+}
+
+/* Waits one sampling period of the current rate after a failed read, a failing bus is retried at that rate */
+static void sensor_backoff(void){
+    struct timespec ts = { 0, 0 };
+
+    pthread_mutex_lock(&rate_mtx);
+        ts.tv_nsec = (sampling_idle == 1 ? ADC_IDLE_PERIOD_US : ADC_ACTIVE_PERIOD_US) * 1000L;
+    pthread_mutex_unlock(&rate_mtx);
+    nanosleep(&ts, NULL);
+}
+
+/* Raises the boom again while it is being lowered, cycle_reverse calls it with mtx held */
+static void lowering_reversed(void* ctx){
+    seq_stop();
+    move_boom(1);
+    actuators_flush();
+}
+
+/* Reacts to a predicted obstruction: boom lowering is postponed, and a lowering already in progress is reversed */
+static void approach_detected(void){
+    metrics_inc(M_PREDICTIONS);
+    cycle_approach(&cyc);
+}
+
+/*
+    Runs the detection logic on one sample, from the sensor thread or a replayed trace: baseline, passage and
+    approach tracking here, detections and the hold in cycle_sample.
+*/
+static void sensor_process(uint64_t t_sample, unsigned mm){
+    track_baseline(t_sample, mm);
+    track_passage(sample_occupied(mm));
+    if(use_predict && predict_feed(&approach, t_sample, mm))
+        approach_detected();
+    update_sampling(sample_near(mm));
+    if(!cycle_held(&cyc) && sample_occupied(mm))
+        RAMP_PROBE2(threshold__cross, mm, t_sample);
+    cycle_sample(&cyc, t_sample, mm, threshold_mm);
+}
+
 /* 
     Thread function reading data from ADC (sensor), comparing it to threshold value, and determining if object in close enough for 
-    servo to go upand buzzer to buzz
+    servo to go upand buzzer to buzz. Sampling goes on during a detection hold, also one taken over from the previous instance.
 */
 void* sensor_controller_fun(void* param){
     char data[2];
-    char thrs = 0x07;
+    uint64_t t_sample;
+    struct trace_record rec;
+    unsigned mm;
+
     while(1){
-        read(adc_fd, data, 2);
-        if(data[0] > thrs){
-            pthread_mutex_lock(&mtx);
-                write(pwm_fd, MOV_UP, strlen(MOV_UP));
-                write(buzz_fd, MOV_UP, strlen(MOV_UP));
-                write(led_fd, "", 1);
-                flag = 1;
-                sleep(RED_SLEEP); // Sleep for same as red light
-            pthread_mutex_unlock(&mtx);
+        if(sensor_read(data) < 0){
+            metrics_inc(M_I2C_ERRORS);
+            sensor_backoff();
+            monitor_beat(&sensor_mon);
+            continue;
+        }
+        t_sample = now_us();
+        if(capture.f != NULL){
+            rec.t_us = t_sample;
+            memcpy(rec.data, data, 2);
+            rec.event = TRACE_EV_NONE;
+            trace_write(&capture, &rec);
         }
+        mm = calib_mm((const unsigned char*)data);
+        RAMP_PROBE3(sensor__sample, mm, calib_raw((const unsigned char*)data), t_sample);
+        sensor_process(t_sample, mm);
+        monitor_beat(&sensor_mon);
     }
 }
 
+/*
+    Shows a step of the phase cycle for cycle_enter. The sequencer enters the step itself when it runs the cycle,
+    otherwise the phase is sent to the drivers. Returns -1 if the step has to be retried.
+*/
+static int show_step(void* ctx, int step){
+    char cmd[16];
+
+    if(seq_fd < 0)
+        return send_to_drivers(phase_msg(cycle_phase[step]));
+    snprintf(cmd, sizeof(cmd), "start %d", step);
+    if(seq_command(cmd) < 0)
+        return -1;
+    seq_running = 1;
+    seq_held = 0;
+    return 0;
+}
+
+/*
+    Returns how long a finished step goes on, 0 to move to the next one: the entry ramp of a full lot stays RED,
+    RED is left only with the shared passage granted and GREEN goes on while vehicles keep coming.
+*/
+static uint64_t step_wait(void* ctx, int step){
+    if(step == 0 && site_lane >= 0 && site_dir == SITE_ENTRY && site_full(&site, now_us()))
+        return SITE_RECHECK_US;
+    if((step == 0 && cyc.flag == 0 && !pair_may_open()) || pair_extend())
+        return PAIR_RECHECK_MS * 1000ULL;
+    return 0;
+}
+
+/* Saves state and accounts what the cycle rules report */
+static void cycle_notify(void* ctx, enum cycle_event ev, uint64_t arg){
+    if(ev == CYCLE_EV_CHANGED){
+        save_state();
+    }
+    else if(ev == CYCLE_EV_DROPPED){
+        metrics_inc(M_DROPPED_COMMANDS);
+    }
+    else if(ev == CYCLE_EV_RELEASED){
+        hold_released = 1;
+        early_releases++;
+        hold_saved_us += arg;
+        metrics_inc(M_EARLY_RELEASES);
+        metrics_observe(H_HOLD_SAVED, arg);
+        printf("Lane clear, detection hold shortened by %llu ms\n", (unsigned long long)(arg / 1000));
+    }
+}
+
+static uint64_t cycle_now(void* ctx){
+    return now_us();
+}
+
+static void cycle_lock(void* ctx, const char* who){
+    ctl_lock(who);
+}
+
+static void cycle_unlock(void* ctx, const char* who){
+    ctl_unlock(who);
+}
+
+static const struct cycle_ops cycle_hooks = {
+    .now = cycle_now,
+    .lock = cycle_lock,
+    .unlock = cycle_unlock,
+    .enter = show_step,
+    .detected = obstacle_detected,
+    .reverse = lowering_reversed,
+    .wait = step_wait,
+    .event = cycle_notify
+};
+
+/*
+    Forces a phase on operator request, waiting at most CONTROL_LOCK_TIMEOUT_MS for the actuators. RED is
+    checked again under the lock, a detection or a vehicle on the loop may have come in the meantime.
+*/
+static int force_phase(const char* msg){
+    if(cycle_held(&cyc) || ctl_timedlock("control", CONTROL_LOCK_TIMEOUT_MS) != 0)
+        return -1;
+    if(strcmp(RED,msg) == 0 && !cycle_may_close(&cyc)){
+        ctl_unlock("control");
+        return -1;
+    }
+
+    seq_stop();
+    apply_phase(msg);
+    if(current_phase == PHASE_RED)
+        pair_acquired = 0;
+    ctl_unlock("control");
+    mode = MODE_FORCED;
+    save_state();
+    return 0;
+}
+
+/*
+    Opens the ramp for a priority vehicle from any source, t_req is the time of the request or 0 if there is
+    nothing to measure. GREEN is shown and the boom raised at once, whatever step or boom move is in progress:
+    the sequencer is stopped and a lowering reverses. Only the control mutex is waited for, which the sensor
+    thread keeps for a few driver writes at most. The safe state takes precedence, the ramp opens when it clears.
+    A ramp sharing a passage opens only on the grant like any other: closed, it stays at RED and reports a
+    priority demand, which the scheduler serves first, and pair_tick calls again until the grant is here.
+*/
+static void priority_open(int src, uint64_t t_req){
+    priority_src |= src;
+    if(mode == MODE_FAILSAFE || (mode == MODE_PRIORITY && !priority_waiting))
+        return;
+    if(mode != MODE_PRIORITY){
+        priority_req_us = t_req;
+        priority_waiting = 0;
+        mode = MODE_PRIORITY;
+        cyc.retry = 0;
+    }
+    if(!pair_may_open()){
+        if(!priority_waiting){
+            ctl_lock("priority");
+                seq_stop();
+            ctl_unlock("priority");
+            priority_waiting = 1;
+            save_state();
+            printf("Priority open waiting for the passage\n");
+        }
+        return;
+    }
+    ctl_lock("priority");
+        seq_stop();
+        apply_phase(GREEN);
+    ctl_unlock("priority");
+    if(priority_req_us != 0){
+        metrics_inc(M_PRIORITY_OPENS);
+        metrics_observe(H_PRIORITY_LATENCY, now_us() - priority_req_us);
+    }
+    priority_waiting = 0;
+    save_state();
+    printf("Priority open\n");
+}
+
+/* Withdraws sources of a priority open, the cycle restarts from RED once none is left */
+static void priority_release(int src){
+    priority_src &= ~src;
+    if(priority_src != 0 || mode != MODE_PRIORITY)
+        return;
+    printf("Priority open ended\n");
+    priority_waiting = 0;
+    mode = MODE_CYCLE;
+    cycle_enter(&cyc, 0);
+}
+
+/* Acts on the last priority signal */
+static void priority_handle(void){
+    uint64_t cnt;
+    int sig;
+
+    read(priority_efd, &cnt, sizeof(cnt));
+    sig = priority_signal;
+    priority_signal = 0;
+    if(sig > 0)
+        priority_open(PRIO_LATCHED, priority_signal_us);
+    else if(sig < 0)
+        priority_release(PRIO_LATCHED);
+}
+
+/* Executes one operator command received on the control socket */
+static void exec_command(const char* cmd, char* reply, size_t len){
+    static const char* mode_name[] = { "cycle", "hold", "forced", "failsafe", "priority" };
+    uint64_t now = now_us();
+
+    if(mode == MODE_FAILSAFE && strcmp(cmd, "state") != 0 && strcmp(cmd, "handoff") != 0){
+        snprintf(reply, len, "ERR failsafe");
+        return;
+    }
+    if(mode == MODE_PRIORITY && strcmp(cmd, "state") != 0 && strcmp(cmd, "handoff") != 0 &&
+       strcmp(cmd, "resume") != 0 && strcmp(cmd, "priority-open") != 0){
+        snprintf(reply, len, "ERR priority");
+        return;
+    }
+
+    if(strcmp(cmd, "priority-open") == 0){
+        priority_open(PRIO_LATCHED, control_batch_us);
+        snprintf(reply, len, "OK");
+    }
+    else if(strcmp(cmd, "force-open") == 0){
+        if(!pair_may_open())
+            snprintf(reply, len, "ERR passage busy");
+        else if(force_phase(GREEN) < 0)
+            snprintf(reply, len, "ERR busy");
+        else
+            snprintf(reply, len, "OK");
+    }
+    else if(strcmp(cmd, "force-close") == 0){
+        if(!cycle_may_close(&cyc))
+            snprintf(reply, len, "ERR obstacle");
+        else if(force_phase(RED) < 0)
+            snprintf(reply, len, "ERR busy");
+        else
+            snprintf(reply, len, "OK");
+    }
+    else if(strcmp(cmd, "hold") == 0){
+        if(mode != MODE_CYCLE){
+            snprintf(reply, len, "ERR not cycling");
+            return;
+        }
+        remaining_us = cyc.deadline_us > now ? cyc.deadline_us - now : 0;
+        if(seq_running)
+            seq_command("hold");
+        mode = MODE_HOLD;
+        save_state();
+        snprintf(reply, len, "OK");
+    }
+    else if(strcmp(cmd, "resume") == 0){
+        if(mode == MODE_PRIORITY){
+            priority_release(PRIO_LATCHED);
+            if(mode == MODE_PRIORITY){
+                snprintf(reply, len, "ERR priority input active");
+                return;
+            }
+        }
+        else if(mode == MODE_HOLD){
+            if(seq_running && !seq_held)
+                seq_command("resume");
+            cyc.deadline_us = now + remaining_us;
+            mode = MODE_CYCLE;
+            save_state();
+        }
+        else if(mode == MODE_FORCED){
+            mode = MODE_CYCLE;
+            cycle_enter(&cyc, 0);
+        }
+        snprintf(reply, len, "OK");
+    }
+    else if(strcmp(cmd, "state") == 0){
+        snprintf(reply, len, "OK phase=%s boom=%s mode=%s remaining_ms=%llu obstacle=%d threshold_mm=%u",
+                 phase_name(current_phase), cyc.boom_up ? "up" : "down", mode_name[mode],
+                 (unsigned long long)(mode == MODE_HOLD ? remaining_us :
+                                      (mode == MODE_CYCLE && cyc.deadline_us > now ? cyc.deadline_us - now : 0)) / 1000,
+                 cyc.flag > 0, threshold_mm);
+    }
+    else if(strcmp(cmd, "handoff") == 0){
+        /* State is saved and the process exits after this reply was sent, see hand_over */
+        handoff_requested = 1;
+        handoff_until_ms = now_ms() + HANDOFF_WAIT_MS / 2;
+        snprintf(reply, len, "OK");
+    }
+    else{
+        snprintf(reply, len, "ERR unknown command");
+    }
+}
+
+/*
+    Supervises the kernel sequencer: holds it before it lowers the boom in front of an approaching vehicle,
+    while an entry ramp of a full lot is at RED, at the end of RED until the shared passage is granted and at
+    the end of GREEN while it is extended, and restarts it after a detection or a watchdog stop.
+*/
+static void seq_supervise(void){
+    int next = (cyc.step + 1) % CYCLE_STEPS;
+    int near_end = cyc.deadline_us <= now_us() + SEQ_PREHOLD_US;
+    int hold;
+
+    if(!seq_running){
+        if(now_us() >= cyc.deadline_us)
+            cycle_enter(&cyc, cyc.step);
+        return;
+    }
+    hold = (cycle_phase[next] == PHASE_RED && cycle_approaching(&cyc)) ||
+           (cyc.step == 0 && site_lane >= 0 && site_dir == SITE_ENTRY && site_full(&site, now_us())) ||
+           (cyc.step == 0 && near_end && cyc.flag == 0 && !pair_may_open()) ||
+           (near_end && pair_extend());
+    if(hold && !seq_held && seq_command("hold") == 0)
+        seq_held = 1;
+    else if(!hold && seq_held && seq_command("resume") == 0)
+        seq_held = 0;
+}
+
+/* Advances the phase cycle when current step is over, or resumes it after a detection hold that ended early */
+static void cycle_tick(void){
+    uint64_t now = now_us();
+
+    if(hold_released){
+        hold_released = 0;
+        if(mode == MODE_CYCLE)
+            cycle_resume(&cyc);
+    }
+    if(mode == MODE_CYCLE && seq_fd >= 0){
+        seq_supervise();
+        return;
+    }
+    if(mode != MODE_CYCLE || now < cyc.deadline_us)
+        return;
+    if(!cyc.retry){
+        metrics_observe(H_WAKEUP_JITTER, now - cyc.deadline_us);
+        if(now - cyc.deadline_us > CYCLE_DEADLINE_US)
+            monitor_miss(&cycle_mon, now - cyc.deadline_us - CYCLE_DEADLINE_US);
+    }
+    cycle_advance(&cyc);
+}
+
+/*
+    Drives the actuators to the safe state, waiting at most CONTROL_LOCK_TIMEOUT_MS for them. Returns -1 and
+    leaves failsafe_pending set if they stay busy, watchdog_tick tries again every main loop pass.
+*/
+static int failsafe_apply(void){
+    if(ctl_timedlock("failsafe", CONTROL_LOCK_TIMEOUT_MS) != 0)
+        return -1;
+
+    set_lights(RED);
+    current_phase = PHASE_RED;
+    move_boom(1);
+    actuators_flush();
+    ctl_unlock("failsafe");
+    failsafe_pending = 0;
+    save_state();
+    return 0;
+}
+
+/* Puts the ramp into the safe state (red light, boom up) and stops the phase cycle */
+static void enter_failsafe(const char* reason){
+    fprintf(stderr, "%s, entering safe state\n", reason);
+    metrics_inc(M_FAILSAFE_ENTRIES);
+    mode = MODE_FAILSAFE;
+    failsafe_pending = 1;
+    seq_stop();
+    if(failsafe_apply() < 0)
+        fprintf(stderr, "Actuators busy, safe state not applied yet\n");
+}
+
+/*
+    Checks that the sensor loop makes progress and kicks the kernel watchdogs. When the sensor loop stalls
+    the ramp goes to the safe state and heartbeats stop, so the drivers enforce it even if this thread dies too.
+*/
+static void watchdog_tick(void){
+    uint64_t now = now_us();
+
+    if(monitor_stalled(&sensor_mon)){
+        if(mode != MODE_FAILSAFE)
+            enter_failsafe("Sensor loop stalled");
+        else if(failsafe_pending)
+            failsafe_apply();
+        return;
+    }
+    if(failsafe_pending)
+        failsafe_apply();
+    else if(mode == MODE_FAILSAFE && !estop){
+        fprintf(stderr, "Safe state cleared, restarting cycle\n");
+        mode = MODE_CYCLE;
+        if(priority_src != 0)
+            priority_open(0, 0);
+        else
+            cycle_enter(&cyc, 0);
+    }
+    if(now - last_kick_us >= WATCHDOG_PERIOD_MS * 1000){
+        watchdog_kick(led_fd, pwm_fd);
+        last_kick_us = now;
+    }
+}
+
+/*
+    Handles events of the discrete inputs. An occupied induction loop holds the boom up like a predicted
+    obstruction, an emergency stop keeps the safe state until it is released, and the priority input keeps
+    the ramp open while active.
+*/
+static void inputs_handle(void){
+    struct gpio_input_event ev[GPIO_INPUT_MAX];
+    ssize_t r;
+    int i;
+
+    while((r = read(input_fd, ev, sizeof(ev))) > 0){
+        for(i = 0; i < r / (ssize_t)sizeof(ev[0]); i++){
+            if(!(ev[i].flags & GPIO_INPUT_INITIAL)){
+                metrics_inc(M_INPUT_EVENTS);
+                metrics_observe(H_INPUT_LATENCY, now_us() - ev[i].t_ns / 1000);
+            }
+            if(ev[i].input == INPUT_LOOP){
+                cyc.loop_occupied = ev[i].active;
+                if(cyc.loop_occupied)
+                    cycle_reverse(&cyc);
+            }
+            else if(ev[i].input == INPUT_ESTOP){
+                estop = ev[i].active;
+                if(estop && mode != MODE_FAILSAFE)
+                    enter_failsafe("Emergency stop");
+            }
+            else if(ev[i].input == INPUT_DEMAND){
+                vehicle_waiting = ev[i].active;
+            }
+            else if(ev[i].input == INPUT_PRIORITY){
+                if(ev[i].active)
+                    priority_open(PRIO_INPUT, ev[i].flags & GPIO_INPUT_INITIAL ? 0 : ev[i].t_ns / 1000);
+                else
+                    priority_release(PRIO_INPUT);
+            }
+        }
+    }
+}
+
+/* Takes over the step the kernel sequencer entered: phase and boom bookkeeping, deadline and saved state */
+static void seq_step_shown(const struct ramp_seq_event* ev){
+    /* A detection is being handled, the sequencer is being stopped then and the step is stale */
+    if(ctl_trylock("seq") != 0)
+        return;
+    if(phase_since_us != 0)
+        RAMP_PROBE2(phase__exit, current_phase, ev->t_ns / 1000 - phase_since_us);
+    cyc.step = ev->step % CYCLE_STEPS;
+    current_phase = cycle_phase[cyc.step];
+    capture_event(lights_event(phase_msg(current_phase)));
+    if(ev->boom != RAMP_SEQ_BOOM_KEEP){
+        capture_event(ev->boom == RAMP_BOOM_UP ? TRACE_EV_BOOM_UP : TRACE_EV_BOOM_DOWN);
+        boom_moved(ev->boom == RAMP_BOOM_UP);
+    }
+    phase_since_us = ev->t_ns / 1000;
+    cyc.deadline_us = ev->end_ns / 1000;
+    cyc.retry = 0;
+    metrics_phase(current_phase);
+    RAMP_PROBE2(phase__enter, current_phase, cyc.step);
+    ctl_unlock("seq");
+    save_state();
+}
+
+/*
+    Handles events of the kernel sequencer. Steps are only taken over while the cycle runs and no detection
+    is pending, anything else was queued before the sequencer was stopped from here.
+*/
+static void seq_handle(void){
+    struct ramp_seq_event ev[8];
+    ssize_t r;
+    int i;
+
+    while((r = read(seq_fd, ev, sizeof(ev))) > 0){
+        for(i = 0; i < r / (ssize_t)sizeof(ev[0]); i++){
+            if(ev[i].type == RAMP_SEQ_EV_STATE && ev[i].running){
+                /* Sequencer kept running while no instance supervised it */
+                seq_running = 1;
+                seq_held = ev[i].held;
+            }
+            else if(ev[i].type == RAMP_SEQ_EV_STOP && ev[i].reason == RAMP_SEQ_BY_WATCHDOG){
+                fprintf(stderr, "Sequencer stopped by a driver watchdog, restarting cycle\n");
+                seq_running = 0;
+                cyc.step = 0;
+                cyc.deadline_us = now_us();
+                continue;
+            }
+            if((ev[i].type == RAMP_SEQ_EV_STEP || (ev[i].type == RAMP_SEQ_EV_STATE && ev[i].running)) &&
+               mode == MODE_CYCLE && cyc.flag == 0 && seq_running){
+                if(ev[i].type == RAMP_SEQ_EV_STEP)
+                    metrics_observe(H_WAKEUP_JITTER, ev[i].late_ns > 0 ? ev[i].late_ns / 1000 : 0);
+                seq_step_shown(&ev[i]);
+            }
+        }
+    }
+}
+
+/* Moves virtual clock to t_us, sleeping the same amount of real time if replay is paced */
+static void replay_advance(uint64_t t_us, int realtime){
+    struct timespec ts;
+    uint64_t now = now_us();
+
+    if(realtime && t_us > now){
+        ts.tv_sec = (t_us - now) / 1000000;
+        ts.tv_nsec = ((t_us - now) % 1000000) * 1000;
+        nanosleep(&ts, NULL);
+    }
+    clock_set(t_us);
+}
+
+/*
+    Feeds a recorded trace through the sensor logic and the phase cycle on a virtual clock and prints the
+    resulting actuator command sequence.
+*/
+static int replay_run(const char* path, int realtime){
+    struct trace tr;
+    struct trace_record rec;
+    unsigned mm;
+
+    if(trace_open(&tr, path) < 0)
+        return -1;
+    clock_use_virtual(tr.wall_start, tr.start_us);
+    replay_start_us = tr.start_us;
+    replay_log = stdout;
+
+    cycle_enter(&cyc, 0);
+    while(trace_read(&tr, &rec)){
+        while(mode == MODE_CYCLE && cyc.deadline_us <= rec.t_us){
+            replay_advance(cyc.deadline_us, realtime);
+            cycle_tick();
+        }
+        replay_advance(rec.t_us, realtime);
+        mm = calib_mm(rec.data);
+        sensor_process(rec.t_us, mm);
+        if(hold_released)
+            cycle_tick();
+    }
+    fprintf(stderr, "Replayed %lu samples, %.3f s of traffic\n", tr.records, (now_us() - tr.start_us) / 1e6);
+    fprintf(stderr, "Detection holds released early: %lu, lane time saved %.1f s\n", early_releases, hold_saved_us / 1e6);
+    trace_close(&tr);
+    passage_stats_print(&stats, stderr);
+    if(use_predict)
+        predict_print(&approach, stderr);
+    baseline_print(&ambient, stderr);
+    return 0;
+}
+
+/* Returns poll timeout in ms until the end of current step, never longer than the heartbeat period */
+static int step_timeout_ms(void){
+    uint64_t now = now_us();
+
+    if(mode != MODE_CYCLE || (seq_running && !cyc.retry))
+        return WATCHDOG_PERIOD_MS;
+    if(cyc.deadline_us <= now)
+        return 0;
+    if(cyc.deadline_us - now > WATCHDOG_PERIOD_MS * 1000)
+        return WATCHDOG_PERIOD_MS;
+    return (cyc.deadline_us - now + 999) / 1000;
+}
+
+/*
+    Resumes the controller where the previous instance left off, without sending anything to the actuators.
+    The saved state is used unless the drivers changed lights or boom after it was saved (e.g. a watchdog trip),
+    otherwise lights, boom and a detection hold in progress are taken from the driver status page.
+    Returns 0 if there is nothing to resume and the cycle has to start from RED.
+*/
+static int restore_state(void){
+    struct ramp_state st;
+    struct ramp_status page;
+    int have_page = status_page_read(&page) == 0;
+
+    if(state_load(state_path, &st) == 0 &&
+       (!have_page || (page.light_ns / 1000 <= st.saved_us && page.boom_ns / 1000 <= st.saved_us))){
+        current_phase = st.phase;
+        cyc.boom_up = st.boom_up;
+        cyc.boom_moved_us = st.boom_moved_us;
+        mode = st.mode;
+        cyc.step = st.cycle_step;
+        cyc.retry = st.step_retry;
+        cyc.flag = st.flag;
+        cyc.deadline_us = st.deadline_us;
+        remaining_us = st.remaining_us;
+        cyc.hold_until_us = st.hold_until_us;
+        return 1;
+    }
+    if(!have_page || page.first_phase_ns == 0)
+        return 0;
+
+    /* Lights were set by a previous instance since the drivers were loaded */
+    cyc.boom_up = page.boom_cmd == RAMP_BOOM_UP;
+    cyc.boom_moved_us = page.boom_ns / 1000;
+    switch(page.light){
+        case RAMP_LIGHT_RED:    cyc.step = 0; break;
+        case RAMP_LIGHT_GREEN:  cyc.step = 2; break;
+        case RAMP_LIGHT_YELLOW: cyc.step = cyc.boom_up ? 3 : 1; break;
+        default:
+            /* Lights are off only during a detection hold, RED follows when it ends */
+            cyc.flag = 1;
+            cyc.hold_until_us = page.light_ns / 1000 + cyc.hold_us;
+            current_phase = PHASE_RED;
+            cyc.retry = 1;
+            cyc.deadline_us = now_us();
+            return 1;
+    }
+    current_phase = cycle_phase[cyc.step];
+    cyc.deadline_us = page.light_ns / 1000 + cyc.phase_us[current_phase];
+    return 1;
+}
+
+/*
+    Saves state for the instance taking over and exits, leaving lights and boom as they are. The sensor thread
+    may be handling a detection, the state is taken once it let go of the actuators. While it does not, the
+    handoff is retried from the main loop and refused after HANDOFF_WAIT_MS / 2; the new instance then gives
+    up instead of resuming from state that misses the detection.
+*/
+static void hand_over(void){
+    if(ctl_timedlock("handoff", CONTROL_LOCK_TIMEOUT_MS) != 0){
+        if(now_ms() < handoff_until_ms)
+            return;
+        fprintf(stderr, "WARNING: Actuators busy, handoff refused\n");
+        handoff_requested = 0;
+        return;
+    }
+
+    save_state();
+    state_flush();
+    if(capture.f != NULL)
+        trace_close(&capture);
+    passage_stats_print(&stats, stdout);
+    exit(0);
+}
+
+/* Closes driver files, prints statistics and exits on SIGINT */
+static void shut_down(void){
+    close(led_fd);
+    close(pwm_fd);
+    close(buzz_fd);
+    close(adc_fd);
+    if(capture.f != NULL){
+        trace_close(&capture);
+        if(capture.dropped > 0)
+            fprintf(stderr, "WARNING: %lu trace blocks dropped, main loop did not keep up\n", capture.dropped);
+    }
+    passage_stats_print(&stats, stdout);
+    exit(1);
+}
+
 /* Main thread, controlling nominal work of servo and LEDs */
-int main()
+int main(int argc, char* argv[])
 {
     pthread_t sensor_controller_th;
     struct sigaction act;
+    struct passage_cfg pcfg = { PASSAGE_MIN_DWELL_MS, PASSAGE_MIN_GAP_MS };
+    const char* metrics_path = METRICS_SOCKET;
+    const char* control_path = CONTROL_SOCKET;
+    struct pollfd fds[CONTROL_MAX_FDS + 3];
+    const char* capture_path = NULL;
+    const char* replay_path = NULL;
+    const char* calib_path = NULL;
+    int realtime = 0;
+    int use_window = 0;
+    int use_seq = 0;
+    int restored;
+    int nfds, input_idx, seq_idx, prio_idx;
+    int drv_fds[3];
+    int opt, n;
+
+    /* -d <ms> minimum dwell, -g <ms> minimum gap for passage detection, -m <path> metrics socket, -c <path> control socket,
+       -r <file> capture sensor trace and actuator commands (compact format), -p <file> replay trace as fast as possible, -t replay in real time,
+       -w set lights through mmap'd GPIO registers instead of write(), -u use io_uring for driver I/O,
+       -a hold boom lowering when an approaching object is predicted from the sensor trend,
+       -k <file> sensor calibration points ("<raw> <mm>" per line), -s <file> saved state,
+       -e <lane> / -x <lane> report passages to the site aggregator as entry / exit ramp,
+       -K run the phase cycle on the kernel sequencer (ramp_seq) and only supervise it,
+       -P <ramp> share a single-lane passage as this ramp of the group scheduled by ramp_pair,
+       -R <ms> end a detection hold once the lane stayed clear this long, 0 keeps the full hold */
+    state_path = STATE_FILE;
+    cycle_init(&cyc, &cycle_hooks, NULL);
+    cyc.phase_us[PHASE_RED] = (uint64_t)RED_SLEEP * 1000000;
+    cyc.phase_us[PHASE_YELLOW] = (uint64_t)YELLOW_SLEEP * 1000000;
+    cyc.phase_us[PHASE_GREEN] = (uint64_t)GREEN_SLEEP * 1000000;
+    cyc.hold_us = (uint64_t)RED_SLEEP * 1000000;
+    while((opt = getopt(argc, argv, "d:g:m:c:r:p:twuak:s:e:x:KP:R:")) != -1){
+        switch(opt){
+            case 'd': pcfg.min_dwell_ms = atoi(optarg); break;
+            case 'g': pcfg.min_gap_ms = atoi(optarg); break;
+            case 'm': metrics_path = optarg; break;
+            case 'c': control_path = optarg; break;
+            case 'r': capture_path = optarg; break;
+            case 'p': replay_path = optarg; break;
+            case 't': realtime = 1; break;
+            case 'w': use_window = 1; break;
+            case 'u': use_uring = 1; break;
+            case 'a': use_predict = 1; break;
+            case 'k': calib_path = optarg; break;
+            case 's': state_path = optarg; break;
+            case 'e': site_lane = atoi(optarg); site_dir = SITE_ENTRY; break;
+            case 'x': site_lane = atoi(optarg); site_dir = SITE_EXIT; break;
+            case 'K': use_seq = 1; break;
+            case 'P': pair_lane = atoi(optarg); break;
+            case 'R': cyc.debounce_us = (uint64_t)atoi(optarg) * 1000; break;
+            default:
+                fprintf(stderr, "Usage: %s [-d min_dwell_ms] [-g min_gap_ms] [-m metrics_socket] [-c control_socket] [-r capture_file] [-p replay_file [-t]] [-w] [-u] [-a] [-k calibration_file] [-s state_file] [-e|-x lane] [-K] [-P ramp] [-R clear_ms]\n", argv[0]);
+                return -1;
+        }
+    }
+    calib_default();
+    if(calib_path != NULL && calib_load(calib_path) < 0){
+        perror("FATAL ERROR: Failed reading calibration file !!\n");
+        return -1;
+    }
+    passage_init(&detector, &pcfg);
+    passage_stats_init(&stats);
+    predict_init(&approach, SENSOR_THRESHOLD_MM, SENSOR_NEAR_MM);
+    baseline_init(&ambient, SENSOR_THRESHOLD_MM);
+    monitor_init(&sensor_mon, "sensor", SENSOR_DEADLINE_US, M_SENSOR_DEADLINE_MISSES);
+    monitor_init(&cycle_mon, "cycle", CYCLE_DEADLINE_US, M_CYCLE_DEADLINE_MISSES);
+
+    if(replay_path != NULL){
+        /* Actuator commands go to /dev/null, the sequence is printed instead */
+        led_fd = open("/dev/null", O_WRONLY);
+        pwm_fd = open("/dev/null", O_WRONLY);
+        buzz_fd = open("/dev/null", O_WRONLY);
+        state_path = NULL;
+        if(replay_run(replay_path, realtime) < 0){
+            perror("FATAL ERROR: Failed reading trace file !!\n");
+            return -1;
+        }
+        return 0;
+    }
+
     memset(&act,0,sizeof(act));
     act.sa_sigaction=kill_handler;
     act.sa_flags=SA_SIGINFO;
     sigaction(SIGINT,&act,NULL);
 
+    /* Priority open on SIGUSR1, released by SIGUSR2 */
+    priority_efd = eventfd(0, EFD_NONBLOCK);
+    if(priority_efd >= 0){
+        act.sa_sigaction=priority_handler;
+        act.sa_flags=SA_SIGINFO | SA_RESTART;
+        sigaction(SIGUSR1,&act,NULL);
+        sigaction(SIGUSR2,&act,NULL);
+    }
+    else
+        perror("WARNING: Priority signals not available");
+
     if(open_drivers() < 0){
         perror("FATAL ERROR: Failed opening device files !!\n");
         return -1;
     }
 
+    /* Discrete inputs are optional: led_driver always creates the device but reports nothing without input_pins */
+    input_fd = open(GPIO_INPUT_DEVICE, O_RDONLY | O_NONBLOCK);
+
+    if(use_seq){
+        seq_fd = open(RAMP_SEQ_DEVICE, O_RDWR | O_NONBLOCK);
+        if(seq_fd < 0 || seq_load() < 0){
+            perror("WARNING: Kernel sequencer not available, cycling from user-space");
+            if(seq_fd >= 0)
+                close(seq_fd);
+            seq_fd = -1;
+        }
+    }
+    /* The sequencer can only start a step from its beginning, a step resumed after a hold gets the full length */
+    cyc.resume_from_start = seq_fd >= 0;
+
+    if(use_window && gpio_window_open(&gpio_win, led_fd) < 0)
+        perror("WARNING: GPIO window not available, using write()");
+    if(use_uring){
+        drv_fds[URING_LED] = led_fd;
+        drv_fds[URING_PWM] = pwm_fd;
+        drv_fds[URING_BUZZ] = buzz_fd;
+        if(uring_io_init(&act_ring, drv_fds, 3) < 0 || uring_io_init(&adc_ring, &adc_fd, 1) < 0){
+            perror("WARNING: io_uring not available, using read()/write()");
+            uring_io_exit(&act_ring);
+            use_uring = 0;
+        }
+    }
+    if(capture_path != NULL && trace_create(&capture, capture_path, now_us(), TRACE_COMPACT) < 0){
+        perror("FATAL ERROR: Failed creating trace file !!\n");
+        return -1;
+    }
+    /* Sensor and actuation paths only code records, the main loop writes the file */
+    if(capture_path != NULL)
+        trace_defer(&capture);
+
+    /* A running instance is asked to hand over only now, when nothing that can fail is left */
+    if(handoff_request(control_path) < 0){
+        fprintf(stderr, "FATAL ERROR: Running instance did not hand over !!\n");
+        return -1;
+    }
+    restored = restore_state();
+    if(seq_fd >= 0){
+        /* A sequencer still running is adopted as it is, its state event comes first */
+        seq_handle();
+        restored |= seq_running;
+    }
+    if(restored){
+        watchdog_kick(led_fd, pwm_fd);
+        last_kick_us = now_us();
+        printf("Resumed %s, boom %s%s\n", phase_name(current_phase), cyc.boom_up ? "up" : "down", cyc.flag > 0 ? ", obstacle" : "");
+    }
+    /* The request behind a priority open is not known any more, it lasts until released by the operator */
+    if(mode == MODE_PRIORITY){
+        priority_src = PRIO_LATCHED;
+        priority_waiting = current_phase != PHASE_GREEN;
+    }
+
+    if(metrics_start(metrics_path) < 0)
+        perror("WARNING: Metrics socket not available");
+    if(control_open(control_path) < 0)
+        perror("WARNING: Control socket not available");
+
     pthread_create(&sensor_controller_th, NULL, sensor_controller_fun, NULL);
 
+    /* Main event loop: phase cycle deadlines and operator commands */
+    if(!restored)
+        cycle_enter(&cyc, 0);
     while(1){
-        goback:
-        send_to_drivers(RED);
-        if(flag > 0){
-            flag = 0;
-            goto goback;
-        }
-        sleep(RED_SLEEP);
-        send_to_drivers(YELLOW);
-        if(flag > 0){
-            flag = 0;
-            goto goback;
-        }
-        sleep(YELLOW_SLEEP);
-        send_to_drivers(GREEN);
-        if(flag > 0){
-            flag = 0;
-            goto goback;
-        }
-        sleep(GREEN_SLEEP);
-        send_to_drivers(YELLOW);
-        if(flag > 0){
-            flag = 0;
-            goto goback;
-        }
-        sleep(YELLOW_SLEEP);
+        n = control_fill_pollfds(fds);
+        nfds = n < 0 ? -n : n;
+        input_idx = seq_idx = prio_idx = -1;
+        if(priority_efd >= 0){
+            fds[nfds].fd = priority_efd;
+            fds[nfds].events = POLLIN;
+            prio_idx = nfds++;
+        }
+        if(input_fd >= 0){
+            fds[nfds].fd = input_fd;
+            fds[nfds].events = POLLIN;
+            input_idx = nfds++;
+        }
+        if(seq_fd >= 0){
+            fds[nfds].fd = seq_fd;
+            fds[nfds].events = POLLIN;
+            seq_idx = nfds++;
+        }
+        poll(fds, nfds, n < 0 ? 0 : step_timeout_ms());
+        if(stop_requested)
+            shut_down();
+        if(capture.f != NULL && trace_drain(&capture) < 0)
+            perror("WARNING: Failed writing trace");
+        /* Priority requests first, before anything else that may take the control mutex */
+        if(prio_idx >= 0 && (fds[prio_idx].revents & POLLIN))
+            priority_handle();
+        if(input_idx >= 0 && (fds[input_idx].revents & POLLIN))
+            inputs_handle();
+        if(seq_idx >= 0 && (fds[seq_idx].revents & POLLIN))
+            seq_handle();
+        control_handle(fds, n, exec_command);
+        if(handoff_requested)
+            hand_over();
+        pair_tick();
+        cycle_tick();
+        watchdog_tick();
+        site_tick();
+        state_flush();
     }
     return 0;
 }
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "metrics.h"
+
+/*
+    All metrics are lock-free atomics updated with relaxed ordering, so control threads never block on
+    the exporter and exporting never touches the control mutex.
+*/
+
+#define HIST_BUCKETS 16
+#define EXPORT_BUF_LEN 16384
+
+/* Histogram upper bounds in microseconds, last bucket is +Inf */
+static const uint64_t bucket_le_us[HIST_BUCKETS - 1] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000
+};
+
+struct hist {
+    _Atomic uint64_t buckets[HIST_BUCKETS];
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_us;
+};
+
+static const char* counter_name[M_COUNTER_COUNT] = {
+    "ramp_detections_total",
+    "ramp_vehicles_total",
+    "ramp_actuator_syscalls_total",
+    "ramp_i2c_errors_total",
+    "ramp_dropped_commands_total",
+    "ramp_sensor_deadline_misses_total",
+    "ramp_cycle_deadline_misses_total",
+    "ramp_failsafe_entries_total",
+    "ramp_predicted_obstructions_total",
+    "ramp_input_events_total",
+    "ramp_early_releases_total",
+    "ramp_priority_opens_total"
+};
+
+static const char* counter_help[M_COUNTER_COUNT] = {
+    "Sensor samples above threshold that raised the boom",
+    "Vehicles confirmed by the passage detector",
+    "Syscalls issued to LED, PWM and buzzer drivers (one per batch with io_uring)",
+    "Failed reads from the ADC driver",
+    "Phase commands dropped because of a detection hold",
+    "Sensor loop iterations that exceeded their time budget",
+    "Phase changes that happened later than allowed",
+    "Switches to the safe state because a control loop stalled",
+    "Imminent obstructions predicted from the sensor trend before the threshold was crossed",
+    "Level changes of induction loops, buttons and emergency stops",
+    "Detection holds ended before RED_SLEEP because the lane was seen clear",
+    "Priority open requests from the input, control socket or SIGUSR1 that preempted the cycle"
+};
+
+static const char* hist_name[M_HIST_COUNT] = {
+    "ramp_detection_latency_seconds",
+    "ramp_wakeup_jitter_seconds",
+    "ramp_control_response_seconds",
+    "ramp_input_latency_seconds",
+    "ramp_hold_saved_seconds",
+    "ramp_priority_response_seconds"
+};
+
+static const char* hist_help[M_HIST_COUNT] = {
+    "Time from sensor sample to completed boom raise command",
+    "Main loop oversleep past the requested phase duration",
+    "Time from control socket wakeup until replies to the command batch were sent",
+    "Time from input edge interrupt until the event was handled",
+    "Lane time given back by ending a detection hold when the lane cleared",
+    "Time from priority open request until the boom raise command was issued"
+};
+
+static const char* gauge_name[M_GAUGE_COUNT] = {
+    "ramp_baseline_mm",
+    "ramp_baseline_noise_mm",
+    "ramp_threshold_mm"
+};
+
+static const char* gauge_help[M_GAUGE_COUNT] = {
+    "Distance measured in the empty lane, tracks sunlight, dirt and temperature drift",
+    "Standard deviation of the empty lane distance",
+    "Detection threshold in use, adjusted to the baseline"
+};
+
+static _Atomic uint64_t counters[M_COUNTER_COUNT];
+static _Atomic double gauges[M_GAUGE_COUNT];
+static _Atomic uint64_t phase_transitions[PHASE_COUNT];
+static struct hist hists[M_HIST_COUNT];
+static int listen_fd = -1;
+
+void metrics_inc(enum metric_counter c){
+    atomic_fetch_add_explicit(&counters[c], 1, memory_order_relaxed);
+}
+
+void metrics_set(enum metric_gauge g, double v){
+    atomic_store_explicit(&gauges[g], v, memory_order_relaxed);
+}
+
+void metrics_phase(int phase){
+    if(phase >= 0 && phase < PHASE_COUNT)
+        atomic_fetch_add_explicit(&phase_transitions[phase], 1, memory_order_relaxed);
+}
+
+void metrics_observe(enum metric_hist h, uint64_t us){
+    int i;
+
+    for(i = 0; i < HIST_BUCKETS - 1; i++)
+        if(us <= bucket_le_us[i])
+            break;
+    atomic_fetch_add_explicit(&hists[h].buckets[i], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hists[h].count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hists[h].sum_us, us, memory_order_relaxed);
+}
+
+/* Renders all metrics in Prometheus text exposition format, returns number of bytes written */
+static int metrics_render(char* buf, size_t len){
+    size_t n = 0;
+    uint64_t cumulative;
+    int i, j;
+
+#define EMIT(...) do { \
+        int r = snprintf(buf + n, len - n, __VA_ARGS__); \
+        if(r < 0 || (size_t)r >= len - n) return n; \
+        n += r; \
+    } while(0)
+
+    for(i = 0; i < M_COUNTER_COUNT; i++){
+        EMIT("# HELP %s %s\n# TYPE %s counter\n", counter_name[i], counter_help[i], counter_name[i]);
+        EMIT("%s %llu\n", counter_name[i],
+             (unsigned long long)atomic_load_explicit(&counters[i], memory_order_relaxed));
+    }
+
+    for(i = 0; i < M_GAUGE_COUNT; i++){
+        EMIT("# HELP %s %s\n# TYPE %s gauge\n", gauge_name[i], gauge_help[i], gauge_name[i]);
+        EMIT("%s %g\n", gauge_name[i], atomic_load_explicit(&gauges[i], memory_order_relaxed));
+    }
+
+    EMIT("# HELP ramp_phase_transitions_total Semaphore phase changes\n# TYPE ramp_phase_transitions_total counter\n");
+    for(i = 0; i < PHASE_COUNT; i++)
+        EMIT("ramp_phase_transitions_total{phase=\"%s\"} %llu\n", phase_name(i),
+             (unsigned long long)atomic_load_explicit(&phase_transitions[i], memory_order_relaxed));
+
+    for(i = 0; i < M_HIST_COUNT; i++){
+        EMIT("# HELP %s %s\n# TYPE %s histogram\n", hist_name[i], hist_help[i], hist_name[i]);
+        cumulative = 0;
+        for(j = 0; j < HIST_BUCKETS; j++){
+            cumulative += atomic_load_explicit(&hists[i].buckets[j], memory_order_relaxed);
+            if(j < HIST_BUCKETS - 1)
+                EMIT("%s_bucket{le=\"%g\"} %llu\n", hist_name[i], bucket_le_us[j] / 1e6, (unsigned long long)cumulative);
+            else
+                EMIT("%s_bucket{le=\"+Inf\"} %llu\n", hist_name[i], (unsigned long long)cumulative);
+        }
+        EMIT("%s_sum %.6f\n", hist_name[i], atomic_load_explicit(&hists[i].sum_us, memory_order_relaxed) / 1e6);
+        EMIT("%s_count %llu\n", hist_name[i],
+             (unsigned long long)atomic_load_explicit(&hists[i].count, memory_order_relaxed));
+    }
+#undef EMIT
+    return n;
+}
+
+/* Exporter thread, every accepted connection gets one snapshot and is closed */
+static void* metrics_fun(void* param){
+    static char buf[EXPORT_BUF_LEN];
+    int client, n;
+
+    while(1){
+        client = accept(listen_fd, NULL, NULL);
+        if(client < 0)
+            continue;
+        n = metrics_render(buf, sizeof(buf));
+        send(client, buf, n, MSG_NOSIGNAL);
+        close(client);
+    }
+    return NULL;
+}
+
+/* Creates metrics socket on given path and starts exporter thread */
+int metrics_start(const char* path){
+    struct sockaddr_un addr;
+    pthread_t th;
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if(bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 4) < 0){
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    if(pthread_create(&th, NULL, metrics_fun, NULL) != 0)
+        return -1;
+    pthread_detach(th);
+    return 0;
+}
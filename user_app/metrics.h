@@ -0,0 +1,51 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include "ramp.h"
+
+#define METRICS_SOCKET "/tmp/ramp_metrics.sock" /* Default path of metrics socket */
+
+/* Plain counters, all monotonically increasing */
+enum metric_counter {
+    M_DETECTIONS = 0,    /* Samples above threshold that triggered boom raise */
+    M_VEHICLES,          /* Vehicles confirmed by passage detector */
+    M_ACTUATOR_SYSCALLS, /* write() calls or io_uring batches to LED, PWM and buzzer drivers */
+    M_I2C_ERRORS,        /* Failed ADC reads */
+    M_DROPPED_COMMANDS,  /* Phase commands not sent because of detection hold */
+    M_SENSOR_DEADLINE_MISSES, /* Sensor loop iterations over SENSOR_DEADLINE_US */
+    M_CYCLE_DEADLINE_MISSES,  /* Phase changes later than CYCLE_DEADLINE_US */
+    M_FAILSAFE_ENTRIES,  /* Switches to safe state because a loop stalled */
+    M_PREDICTIONS,       /* Obstructions predicted from the sensor trend */
+    M_INPUT_EVENTS,      /* Level changes of discrete inputs */
+    M_EARLY_RELEASES,    /* Detection holds ended early because the lane cleared */
+    M_PRIORITY_OPENS,    /* Priority open requests that preempted the cycle */
+    M_COUNTER_COUNT
+};
+
+/* Latency histograms, observed values are in microseconds */
+enum metric_hist {
+    H_DETECTION_LATENCY = 0, /* Sample read -> boom raise command done */
+    H_WAKEUP_JITTER,         /* Main loop oversleep past the requested phase duration */
+    H_CONTROL_LATENCY,       /* Control socket wakeup -> replies for the whole batch sent */
+    H_INPUT_LATENCY,         /* Input edge interrupt -> event handled */
+    H_HOLD_SAVED,            /* Detection hold time saved by an early release */
+    H_PRIORITY_LATENCY,      /* Priority open request -> boom raise command done */
+    M_HIST_COUNT
+};
+
+/* Gauges, last set value is exported */
+enum metric_gauge {
+    G_BASELINE_MM = 0,       /* Empty lane distance */
+    G_BASELINE_NOISE_MM,     /* Standard deviation of the empty lane distance */
+    G_THRESHOLD_MM,          /* Detection threshold in use */
+    M_GAUGE_COUNT
+};
+
+void metrics_inc(enum metric_counter c);
+void metrics_set(enum metric_gauge g, double v);
+void metrics_phase(int phase);
+void metrics_observe(enum metric_hist h, uint64_t us);
+int metrics_start(const char* path);
+
+#endif
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pair.h"
+
+#define PAIR_MAGIC 0x52505352 /* "RSPR" */
+
+void pair_sched_init(struct pair_sched* ps, int lanes, uint64_t clear_us, enum pair_policy policy){
+    memset(ps, 0, sizeof(*ps));
+    ps->lanes = lanes;
+    ps->policy = policy;
+    ps->clear_us = clear_us;
+    ps->grant = -1;
+    ps->last = lanes - 1;           /* First grant goes to ramp 0 when nobody is waiting */
+    ps->next = -1;
+    ps->served = 1;
+}
+
+/*
+    Picks the ramp to get the passage after the current or last holder. Adaptive: the holder keeps it while it
+    waits for its first opening, otherwise the ramp waiting longest gets it, and the holder keeps it while
+    nobody else waits. Without any demand, and always with the fixed policy, ramps take turns once the holder
+    has opened. A ramp waiting for a priority open goes before all of that with either policy.
+*/
+static int pair_choose(struct pair_sched* ps){
+    int holder = ps->grant >= 0 ? ps->grant : ps->last;
+    int best = -1;
+    int i;
+
+    for(i = 0; i < ps->lanes; i++)
+        if(ps->priority[i] && (best < 0 || ps->wait_us[i] < ps->wait_us[best]))
+            best = i;
+    if(best >= 0)
+        return best;
+    if(ps->policy == PAIR_ADAPTIVE){
+        if(ps->grant >= 0 && !ps->served && ps->wait_us[holder])
+            return holder;
+        for(i = 0; i < ps->lanes; i++)
+            if(ps->wait_us[i] && (i != holder || ps->grant < 0) && (best < 0 || ps->wait_us[i] < ps->wait_us[best]))
+                best = i;
+        if(best >= 0)
+            return best;
+        if(ps->grant >= 0 && ps->wait_us[holder])
+            return holder;
+    }
+    if(ps->grant >= 0 && !ps->served)
+        return holder;
+    return (holder + 1) % ps->lanes;
+}
+
+/*
+    One scheduler decision from the ramps' reports, returns the grant. The grant is withdrawn only from a
+    closed ramp, and given only when all ramps were closed for clear_us; a ramp that opens during clearance
+    (detection, safe state) restarts it. A decision that withdraws the grant never gives it in the same call:
+    the withdrawal has to be published first, and only reports read after that may show the former holder
+    closed, as it may have opened on the grant between the reports were read and the withdrawal.
+*/
+int pair_decide(struct pair_sched* ps, uint64_t now_us, const int open[], const int demand[]){
+    uint64_t last_open = 0;
+    int any_open = 0;
+    int any_priority = 0;
+    int withdrawn = 0;
+    int i, target;
+
+    for(i = 0; i < ps->lanes; i++){
+        if(open[i]){
+            ps->open_us[i] = now_us;
+            any_open = 1;
+        }
+        ps->priority[i] = demand[i] == PAIR_DEMAND_PRIORITY;
+        any_priority |= ps->priority[i];
+        if(!demand[i])
+            ps->wait_us[i] = 0;
+        else if(!ps->wait_us[i])
+            ps->wait_us[i] = now_us;
+        if(ps->open_us[i] > last_open)
+            last_open = ps->open_us[i];
+    }
+
+    if(ps->grant >= 0){
+        if(open[ps->grant])
+            ps->served = 1;
+        else if((target = pair_choose(ps)) != ps->grant){
+            ps->last = ps->grant;
+            ps->grant = -1;
+            ps->next = target;
+            withdrawn = 1;
+        }
+    }
+    if(ps->grant < 0 && !withdrawn){
+        /* A priority request arriving during clearance takes the place of the ramp chosen before */
+        if(ps->next < 0 || (any_priority && !ps->priority[ps->next]))
+            ps->next = pair_choose(ps);
+        if(!any_open && now_us - last_open >= ps->clear_us){
+            ps->grant = ps->next;
+            ps->next = -1;
+            ps->served = 0;
+            ps->switches++;
+        }
+    }
+
+    ps->green_ms = 0;
+    if(ps->policy == PAIR_ADAPTIVE){
+        ps->green_ms = PAIR_MAX_GREEN_MS;
+        for(i = 0; i < ps->lanes; i++)
+            if(i != ps->grant && demand[i] && ps->green_ms > 0)
+                ps->green_ms = ps->priority[i] ? 0 : PAIR_SHARED_GREEN_MS;
+    }
+    return ps->grant;
+}
+
+/* Initializes a freshly created segment, magic is written last so attaching processes never see it half done */
+static void pair_init(struct pair_shm* shm, int lanes){
+    memset(shm, 0, sizeof(*shm));
+    shm->lanes = lanes;
+    atomic_store_explicit(&shm->grant, -1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    __atomic_store_n(&shm->magic, PAIR_MAGIC, __ATOMIC_RELEASE);
+}
+
+/*
+    Maps the group segment. The scheduler passes create=1 and the number of ramps, a segment left by a previous
+    run is reinitialized. Ramps pass create=0 and get -1 if no scheduler has created it yet.
+*/
+int pair_open(struct pair* p, const char* name, int create, int lanes){
+    struct pair_shm* shm;
+    struct stat st;
+    int fd;
+
+    p->shm = NULL;
+    p->created = 0;
+    if(create && (lanes < 1 || lanes > PAIR_LANES))
+        return -1;
+    fd = create ? shm_open(name, O_RDWR | O_CREAT, 0666) : shm_open(name, O_RDWR, 0);
+    if(fd < 0)
+        return -1;
+    if(create && ftruncate(fd, sizeof(*shm)) < 0){
+        close(fd);
+        return -1;
+    }
+    /* A segment just created by the scheduler may not have its size yet */
+    if(!create && (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*shm))){
+        close(fd);
+        return -1;
+    }
+
+    shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(shm == MAP_FAILED)
+        return -1;
+    if(create)
+        pair_init(shm, lanes);
+    else if(__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != PAIR_MAGIC){
+        munmap(shm, sizeof(*shm));
+        return -1;
+    }
+    p->shm = shm;
+    p->created = create;
+    return 0;
+}
+
+void pair_close(struct pair* p){
+    if(p->shm != NULL)
+        munmap(p->shm, sizeof(*p->shm));
+    p->shm = NULL;
+}
+
+/*
+    Publishes the state of one ramp. Open is stored before the ramp reads the grant, and the scheduler publishes
+    a withdrawal before it reads the reports the next grant is based on (pair_decide never withdraws and grants
+    in one decision), both sequentially consistent. So a ramp cannot open on a grant the scheduler has already
+    taken away without the scheduler seeing it open before it grants another ramp.
+*/
+void pair_report(struct pair* p, int lane, int open, int demand, uint64_t now_us){
+    if(p->shm == NULL || lane >= (int)p->shm->lanes)
+        return;
+    atomic_store(&p->shm->lane[lane].open, open);
+    atomic_store_explicit(&p->shm->lane[lane].demand, demand, memory_order_relaxed);
+    atomic_store_explicit(&p->shm->lane[lane].seen_us, now_us, memory_order_relaxed);
+}
+
+/* Returns 1 if the ramp holds the grant of a live scheduler */
+int pair_granted(struct pair* p, int lane, uint64_t now_us){
+    if(p->shm == NULL || atomic_load(&p->shm->grant) != lane)
+        return 0;
+    return now_us - atomic_load_explicit(&p->shm->alive_us, memory_order_relaxed) < PAIR_STALE_MS * 1000ULL;
+}
+
+/* Returns the longest GREEN the granted ramp may keep while it has demand, 0 when the scheduler is not available */
+uint32_t pair_green_ms(struct pair* p){
+    return p->shm == NULL ? 0 : atomic_load_explicit(&p->shm->green_ms, memory_order_relaxed);
+}
@@ -0,0 +1,79 @@
+#ifndef PAIR_H
+#define PAIR_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+    Coordination of ramps sharing one single-lane passage, e.g. the entry and exit ramp of a narrow gate.
+    tools/ramp_pair.c runs the scheduler and grants the passage to one ramp at a time through POSIX shared
+    memory. A ramp may leave RED only while it holds the grant, and the grant moves to another ramp only after
+    every ramp of the group was closed (RED, boom down) for the all-red clearance interval, as seen in reports
+    read after the withdrawal was published. Ramps report whether they are open and whether vehicles are
+    waiting; the scheduler serves the ramp waiting longest, skips ramps without demand and lets the ramp
+    holding the passage extend its GREEN while vehicles keep coming, longer when nobody else waits. A ramp
+    reporting PAIR_DEMAND_PRIORITY gets the grant next and the holder loses its extension.
+    tools/pair_check.c verifies the protocol against interleaved ramp and scheduler steps.
+*/
+#define PAIR_SHM "/ramp_pair"       /* Default name of the shared memory segment */
+#define PAIR_LANES 8                /* Most ramps in one group */
+#define PAIR_CLEAR_MS 3000          /* Default all-red clearance between grants */
+#define PAIR_PERIOD_MS 10           /* Scheduler decision period */
+#define PAIR_STALE_MS 1000          /* Reports older than this are not trusted */
+#define PAIR_RECHECK_MS 100         /* Period a ramp re-checks the grant or its GREEN extension */
+#define PAIR_MAX_GREEN_MS 12000     /* Longest GREEN of a ramp with demand while nobody else waits */
+#define PAIR_SHARED_GREEN_MS 8000   /* Longest GREEN of a ramp with demand while others wait */
+#define PAIR_DEMAND_PRIORITY 2      /* Demand of a ramp waiting for a priority open, served before any other */
+
+enum pair_policy {
+    PAIR_FIXED = 0,                 /* Grant goes round in turn after every cycle, no extension */
+    PAIR_ADAPTIVE                   /* Grant follows demand */
+};
+
+struct pair_lane {
+    _Atomic int32_t open;           /* Ramp is open or about to open, written by the ramp */
+    _Atomic int32_t demand;         /* Vehicles are waiting or passing */
+    _Atomic uint64_t seen_us;       /* CLOCK_MONOTONIC time of the last report */
+};
+
+struct pair_shm {
+    uint32_t magic;                 /* Set last, once the segment is initialized */
+    uint32_t lanes;
+    _Atomic int32_t grant;          /* Ramp allowed to open, -1 while all are held at RED */
+    _Atomic uint32_t green_ms;      /* Longest GREEN the granted ramp may keep with demand, 0 for no extension */
+    _Atomic uint64_t alive_us;      /* Last decision of the scheduler */
+    _Atomic uint32_t switches;      /* Grants given */
+    struct pair_lane lane[PAIR_LANES];
+};
+
+struct pair {
+    struct pair_shm* shm;           /* NULL when the group is not available */
+    int created;                    /* Segment was created, not reused */
+};
+
+/* Scheduler state, also driven by tools/ramp_sim.c on a virtual clock */
+struct pair_sched {
+    int lanes;
+    enum pair_policy policy;
+    uint64_t clear_us;
+    int grant;                      /* Current grant, -1 during clearance */
+    int last;                       /* Ramp that held the grant last */
+    int next;                       /* Ramp the grant goes to after clearance, -1 if not chosen yet */
+    int served;                     /* Granted ramp has opened since it got the grant */
+    uint32_t green_ms;
+    uint64_t open_us[PAIR_LANES];   /* Last time each ramp was seen open */
+    uint64_t wait_us[PAIR_LANES];   /* Start of the current demand, 0 without demand */
+    int priority[PAIR_LANES];       /* Ramp waits for a priority open */
+    unsigned long switches;
+};
+
+void pair_sched_init(struct pair_sched* ps, int lanes, uint64_t clear_us, enum pair_policy policy);
+int pair_decide(struct pair_sched* ps, uint64_t now_us, const int open[], const int demand[]);
+
+int pair_open(struct pair* p, const char* name, int create, int lanes);
+void pair_close(struct pair* p);
+void pair_report(struct pair* p, int lane, int open, int demand, uint64_t now_us);
+int pair_granted(struct pair* p, int lane, uint64_t now_us);
+uint32_t pair_green_ms(struct pair* p);
+
+#endif
@@ -0,0 +1,138 @@
+#include <string.h>
+#include "passage.h"
+
+/* Initializes detector with given configuration, or defaults if cfg is NULL */
+void passage_init(struct passage_detector* pd, const struct passage_cfg* cfg){
+    memset(pd, 0, sizeof(*pd));
+    if(cfg != NULL){
+        pd->cfg = *cfg;
+    }
+    else{
+        pd->cfg.min_dwell_ms = PASSAGE_MIN_DWELL_MS;
+        pd->cfg.min_gap_ms = PASSAGE_MIN_GAP_MS;
+    }
+    pd->state = PD_IDLE;
+}
+
+/*
+    Feeds one binary sample (object under the boom or not) into the detector.
+    Short pulses are filtered by min_dwell, short gaps (e.g. between truck and trailer) by min_gap.
+    Returns 1 and fills ev when sample produced an event, 0 otherwise.
+*/
+int passage_feed(struct passage_detector* pd, int occupied, uint64_t t_ms, struct passage_event* ev){
+    ev->type = PASSAGE_NONE;
+    ev->t_ms = t_ms;
+    ev->dwell_ms = 0;
+
+    switch(pd->state){
+        case PD_IDLE:
+            if(occupied){
+                pd->t_enter = t_ms;
+                pd->state = PD_PENDING;
+            }
+            break;
+        case PD_PENDING:
+            if(!occupied){
+                pd->glitches++;
+                pd->state = PD_IDLE;
+            }
+            else if(t_ms - pd->t_enter >= pd->cfg.min_dwell_ms){
+                pd->state = PD_PRESENT;
+                pd->t_next_dwell = pd->t_enter + PASSAGE_DWELL_TICK_MS;
+                ev->type = PASSAGE_ENTER;
+                ev->t_ms = pd->t_enter;
+            }
+            break;
+        case PD_PRESENT:
+            if(!occupied){
+                pd->t_clear = t_ms;
+                pd->state = PD_LEAVING;
+            }
+            else if(t_ms >= pd->t_next_dwell){
+                pd->t_next_dwell += PASSAGE_DWELL_TICK_MS;
+                ev->type = PASSAGE_DWELL;
+                ev->dwell_ms = t_ms - pd->t_enter;
+            }
+            break;
+        case PD_LEAVING:
+            if(occupied){
+                /* Gap too short, still the same vehicle */
+                pd->state = PD_PRESENT;
+            }
+            else if(t_ms - pd->t_clear >= pd->cfg.min_gap_ms){
+                pd->state = PD_IDLE;
+                ev->type = PASSAGE_EXIT;
+                ev->t_ms = pd->t_clear;
+                ev->dwell_ms = pd->t_clear - pd->t_enter;
+            }
+            break;
+    }
+    return ev->type != PASSAGE_NONE;
+}
+
+void passage_stats_init(struct passage_stats* st){
+    memset(st, 0, sizeof(*st));
+    pthread_mutex_init(&st->lock, NULL);
+}
+
+/* Accounts one detector event to the phase and hour buckets it happened in */
+void passage_stats_event(struct passage_stats* st, const struct passage_event* ev, int phase, int hour){
+    struct passage_counters* p;
+    struct passage_counters* h;
+
+    if(phase < 0 || phase >= PHASE_COUNT || hour < 0 || hour >= PASSAGE_HOURS)
+        return;
+    p = &st->phase[phase];
+    h = &st->hour[hour];
+
+    pthread_mutex_lock(&st->lock);
+        if(ev->type == PASSAGE_ENTER){
+            p->vehicles++;
+            h->vehicles++;
+        }
+        else if(ev->type == PASSAGE_EXIT){
+            p->exits++;
+            h->exits++;
+            p->dwell_sum_ms += ev->dwell_ms;
+            h->dwell_sum_ms += ev->dwell_ms;
+        }
+    pthread_mutex_unlock(&st->lock);
+}
+
+/* Accounts one full boom raise/lower cycle */
+void passage_stats_boom_cycle(struct passage_stats* st, int phase, int hour){
+    if(phase < 0 || phase >= PHASE_COUNT || hour < 0 || hour >= PASSAGE_HOURS)
+        return;
+    pthread_mutex_lock(&st->lock);
+        st->phase[phase].boom_cycles++;
+        st->hour[hour].boom_cycles++;
+    pthread_mutex_unlock(&st->lock);
+}
+
+static void print_counters(FILE* out, const char* name, const struct passage_counters* c){
+    unsigned long long mean = c->exits ? c->dwell_sum_ms / c->exits : 0;
+    fprintf(out, "%-8s vehicles=%llu mean_dwell_ms=%llu boom_cycles=%llu\n", name,
+            (unsigned long long)c->vehicles, mean, (unsigned long long)c->boom_cycles);
+}
+
+/* Prints per-phase and non-empty per-hour counters */
+void passage_stats_print(struct passage_stats* st, FILE* out){
+    struct passage_stats copy;
+    char name[8];
+    int i;
+
+    pthread_mutex_lock(&st->lock);
+        memcpy(copy.phase, st->phase, sizeof(copy.phase));
+        memcpy(copy.hour, st->hour, sizeof(copy.hour));
+    pthread_mutex_unlock(&st->lock);
+
+    for(i = 0; i < PHASE_COUNT; i++)
+        print_counters(out, phase_name(i), &copy.phase[i]);
+    for(i = 0; i < PASSAGE_HOURS; i++){
+        if(copy.hour[i].vehicles == 0 && copy.hour[i].boom_cycles == 0)
+            continue;
+        snprintf(name, sizeof(name), "%02d:00", i);
+        print_counters(out, name, &copy.hour[i]);
+    }
+    fflush(out);
+}
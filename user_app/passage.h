@@ -0,0 +1,67 @@
+#ifndef PASSAGE_H
+#define PASSAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "ramp.h"
+
+/* Default detector configuration, customizable */
+#define PASSAGE_MIN_DWELL_MS 300   /* Object must be seen this long to count as a vehicle */
+#define PASSAGE_MIN_GAP_MS 800     /* Lane must be clear this long before vehicle is considered gone */
+#define PASSAGE_DWELL_TICK_MS 1000 /* Period of DWELL events while vehicle stays under the boom */
+
+#define PASSAGE_HOURS 24
+
+/* Events produced by the passage detector */
+enum passage_event_type {
+    PASSAGE_NONE = 0,
+    PASSAGE_ENTER, /* Vehicle confirmed under the boom */
+    PASSAGE_DWELL, /* Vehicle still present, emitted every PASSAGE_DWELL_TICK_MS */
+    PASSAGE_EXIT   /* Vehicle left the lane */
+};
+
+struct passage_event {
+    enum passage_event_type type;
+    uint64_t t_ms;     /* Time of the event (rising edge for ENTER) */
+    uint64_t dwell_ms; /* Time spent under the boom so far (DWELL) or in total (EXIT) */
+};
+
+struct passage_cfg {
+    uint32_t min_dwell_ms;
+    uint32_t min_gap_ms;
+};
+
+/* Edge detector state, one per lane */
+struct passage_detector {
+    struct passage_cfg cfg;
+    enum { PD_IDLE, PD_PENDING, PD_PRESENT, PD_LEAVING } state;
+    uint64_t t_enter;      /* Rising edge that started current vehicle */
+    uint64_t t_clear;      /* Falling edge while leaving */
+    uint64_t t_next_dwell; /* When next DWELL event is due */
+    uint64_t glitches;     /* Rising edges shorter than min_dwell */
+};
+
+/* Throughput counters for one bucket (phase or hour) */
+struct passage_counters {
+    uint64_t vehicles;
+    uint64_t exits;
+    uint64_t dwell_sum_ms;
+    uint64_t boom_cycles;
+};
+
+struct passage_stats {
+    pthread_mutex_t lock;
+    struct passage_counters phase[PHASE_COUNT];
+    struct passage_counters hour[PASSAGE_HOURS];
+};
+
+void passage_init(struct passage_detector* pd, const struct passage_cfg* cfg);
+int passage_feed(struct passage_detector* pd, int occupied, uint64_t t_ms, struct passage_event* ev);
+
+void passage_stats_init(struct passage_stats* st);
+void passage_stats_event(struct passage_stats* st, const struct passage_event* ev, int phase, int hour);
+void passage_stats_boom_cycle(struct passage_stats* st, int phase, int hour);
+void passage_stats_print(struct passage_stats* st, FILE* out);
+
+#endif
@@ -0,0 +1,107 @@
+#include <string.h>
+#include "predict.h"
+
+void predict_init(struct predictor* p, int threshold_mm, int far_mm){
+    memset(p, 0, sizeof(*p));
+    p->threshold_mm = threshold_mm;
+    p->far_mm = far_mm;
+}
+
+/* Least squares fit of the window, returns slope in mm per second and fitted distance at t_now */
+static int predict_fit(const struct predictor* p, uint64_t t_now, double* slope, double* mm){
+    double st = 0, sv = 0, stt = 0, stv = 0, x, d;
+    unsigned i, idx, n = 0;
+
+    for(i = 0; i < p->count; i++){
+        idx = (p->head + PREDICT_RING - 1 - i) % PREDICT_RING;
+        if(t_now - p->t[idx] > PREDICT_WINDOW_MS * 1000ULL)
+            break;
+        x = -(double)(t_now - p->t[idx]) / 1e6;
+        st += x;
+        sv += p->v[idx];
+        stt += x * x;
+        stv += x * p->v[idx];
+        n++;
+    }
+    if(n < PREDICT_MIN_SAMPLES)
+        return 0;
+    d = n * stt - st * st;
+    if(d <= 0)
+        return 0;
+    *slope = (n * stv - st * sv) / d;
+    *mm = (sv - *slope * st) / n;
+    return 1;
+}
+
+/* Scores an open flag when the lane gets obstructed or the flag expires */
+static void predict_score(struct predictor* p, uint64_t t_us, int crossed){
+    if(crossed){
+        if(p->imminent){
+            p->confirmed++;
+            p->lead_sum_us += t_us - p->t_flag;
+        }
+        else
+            p->missed++;
+        p->imminent = 0;
+    }
+    else if(p->imminent && t_us - p->t_flag > 2 * PREDICT_HORIZON_MS * 1000ULL){
+        p->false_alarms++;
+        p->imminent = 0;
+    }
+}
+
+/*
+    Feeds one sample. Returns 1 when an imminent obstruction is flagged by this sample.
+    A gap longer than the window (detection hold, idle sampling) starts a new estimate.
+*/
+int predict_feed(struct predictor* p, uint64_t t_us, int mm){
+    double slope, fitted, eta_ms;
+    int over = mm <= p->threshold_mm;
+
+    if(p->count > 0 && t_us - p->t[(p->head + PREDICT_RING - 1) % PREDICT_RING] > PREDICT_WINDOW_MS * 1000ULL){
+        p->count = 0;
+        p->streak = 0;
+        p->was_over = 0;
+    }
+    p->t[p->head] = t_us;
+    p->v[p->head] = mm;
+    p->head = (p->head + 1) % PREDICT_RING;
+    if(p->count < PREDICT_RING)
+        p->count++;
+
+    if(over && !p->was_over)
+        predict_score(p, t_us, 1);
+    p->was_over = over;
+    predict_score(p, t_us, 0);
+    if(over || p->imminent || mm >= p->far_mm){
+        p->streak = 0;
+        return 0;
+    }
+
+    if(!predict_fit(p, t_us, &slope, &fitted) || -slope < PREDICT_MIN_SPEED){
+        p->streak = 0;
+        return 0;
+    }
+    eta_ms = (fitted - p->threshold_mm) / -slope * 1000;
+    if(eta_ms > PREDICT_HORIZON_MS){
+        p->streak = 0;
+        return 0;
+    }
+    if(++p->streak < PREDICT_CONFIRM)
+        return 0;
+
+    p->streak = 0;
+    p->imminent = 1;
+    p->t_flag = t_us;
+    p->flags++;
+    return 1;
+}
+
+void predict_print(const struct predictor* p, FILE* out){
+    fprintf(out, "Approach prediction: %llu flagged, %llu confirmed, %llu false alarms, %llu crossings missed",
+            (unsigned long long)p->flags, (unsigned long long)p->confirmed,
+            (unsigned long long)p->false_alarms, (unsigned long long)p->missed);
+    if(p->confirmed > 0)
+        fprintf(out, ", mean lead %.1f ms", p->lead_sum_us / 1e3 / p->confirmed);
+    fprintf(out, "\n");
+}
@@ -0,0 +1,45 @@
+#ifndef PREDICT_H
+#define PREDICT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+    Approach predictor. Fits a line through the distances measured in the last PREDICT_WINDOW_MS and flags an
+    imminent obstruction when the fitted distance falls fast enough to reach the threshold within the horizon.
+    Every flag is scored against what the sensor shows afterwards, so the false alarm rate can be measured
+    on recorded traces.
+*/
+#define PREDICT_WINDOW_MS 250    /* Samples used for the slope estimate */
+#define PREDICT_HORIZON_MS 300   /* Flag obstruction expected at most this far ahead */
+#define PREDICT_MIN_SPEED 200.0  /* Closing speed in mm/s, slower changes are not an approach */
+#define PREDICT_CONFIRM 3        /* Consecutive samples that must agree before flagging */
+#define PREDICT_MIN_SAMPLES 8    /* Least samples in the window for a slope estimate */
+
+#define PREDICT_RING 128
+
+struct predictor {
+    int threshold_mm;         /* Distance at or below which the lane is obstructed */
+    int far_mm;               /* Distances at or above this are an empty lane */
+    uint64_t t[PREDICT_RING];
+    int v[PREDICT_RING];
+    unsigned head;
+    unsigned count;
+    unsigned streak;          /* Consecutive samples predicting a crossing */
+    int was_over;             /* Previous sample was over the threshold */
+    int imminent;             /* Flag raised, waiting for the crossing or expiry */
+    uint64_t t_flag;
+
+    /* Scores */
+    uint64_t flags;           /* Imminent obstructions flagged */
+    uint64_t confirmed;       /* Flags followed by a threshold crossing within twice the horizon */
+    uint64_t false_alarms;    /* Flags that expired without a crossing */
+    uint64_t missed;          /* Crossings that were not flagged in advance */
+    uint64_t lead_sum_us;     /* Sum of flag to crossing times of confirmed flags */
+};
+
+void predict_init(struct predictor* p, int threshold_mm, int far_mm);
+int predict_feed(struct predictor* p, uint64_t t_us, int mm);
+void predict_print(const struct predictor* p, FILE* out);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+    Static USDT probes of the controller, provider "ramp". Built with -DHAVE_SDT (needs <sys/sdt.h> from
+    systemtap-sdt-dev) every probe is a single nop plus an ELF note, so it costs nothing until bpftrace or
+    perf attaches to it. Without HAVE_SDT the probes compile to nothing.
+
+    phase__enter    (phase, cycle_step)        New phase shown
+    phase__exit     (phase, shown_us)          Phase replaced after being shown for shown_us
+    send__start     (msg)                      send_to_drivers called
+    send__done      (msg, result)              send_to_drivers returned, -1 if actuators were busy
+    sensor__sample  (mm, raw, t_us)            ADC sample converted
+    threshold__cross(mm, t_us)                 Sample close enough to stop the ramp
+    lock__wait      (who)                      Blocking for the control mutex
+    lock__acquired  (who)                      Control mutex taken
+    lock__busy      (who)                      Try or timed lock of the control mutex failed
+    lock__release   (who)                      Control mutex released
+*/
+
+#ifdef HAVE_SDT
+
+#include <sys/sdt.h>
+
+#define RAMP_PROBE1(name, a)       DTRACE_PROBE1(ramp, name, a)
+#define RAMP_PROBE2(name, a, b)    DTRACE_PROBE2(ramp, name, a, b)
+#define RAMP_PROBE3(name, a, b, c) DTRACE_PROBE3(ramp, name, a, b, c)
+
+#else
+
+#define RAMP_PROBE1(name, a)       do {} while(0)
+#define RAMP_PROBE2(name, a, b)    do {} while(0)
+#define RAMP_PROBE3(name, a, b, c) do {} while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef RAMP_H
+#define RAMP_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Semaphore phases, used as index into per-phase statistics */
+enum phase {
+    PHASE_RED = 0,
+    PHASE_YELLOW,
+    PHASE_GREEN,
+    PHASE_COUNT
+};
+
+/* Phase cycle executed by the main loop, also by tools/ramp_sim.c */
+#define CYCLE_STEPS 4
+static const int cycle_phase[CYCLE_STEPS] = { PHASE_RED, PHASE_YELLOW, PHASE_GREEN, PHASE_YELLOW };
+
+/* Sensor levels, customizable, shared with tools/ramp_sim.c */
+#define SENSOR_THRESHOLD_MM 170     /* Object this close stops the ramp, nominal value adjusted to the ambient baseline */
+#define SENSOR_NEAR_MM 280          /* Object this close switches ADC to high rate sampling */
+#define BOOM_TRAVEL_US 1500000      /* Time servo needs for a full boom move */
+#define RELEASE_MARGIN_MM 50        /* Lane counts as clear beyond the threshold plus this margin */
+#define CLEAR_DEBOUNCE_MS 500       /* Default time the lane must stay clear to end a detection hold */
+
+/* Printable phase names, same strings that are sent to the LED driver */
+static inline const char* phase_name(int phase){
+    switch(phase){
+        case PHASE_RED:    return "RED";
+        case PHASE_YELLOW: return "YELLOW";
+        case PHASE_GREEN:  return "GREEN";
+        default:           return "OFF";
+    }
+}
+
+/* Virtual clock used when replaying recorded traces, see clock.c */
+extern int clock_virtual;
+extern uint64_t clock_virtual_us;
+
+/* Monotonic time in microseconds, used for all interval measurements */
+static inline uint64_t now_us(void){
+    struct timespec ts;
+
+    if(clock_virtual)
+        return clock_virtual_us;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Monotonic time in milliseconds */
+static inline uint64_t now_ms(void){
+    return now_us() / 1000;
+}
+
+void clock_use_virtual(time_t wall_base, uint64_t start_us);
+void clock_set(uint64_t t_us);
+time_t wall_time(void);
+
+#endif
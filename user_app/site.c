@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "site.h"
+
+#define SITE_MAGIC 0x54495352 /* "RSIT" */
+
+/*
+    Bounded MPSC queue after D. Vyukov: every slot carries a sequence number. A producer may fill the slot
+    at position pos when its seq equals pos, claims it by advancing head with CAS and publishes it by storing
+    pos + 1. The consumer takes the slot when seq is pos + 1 and hands it back to producers of the next lap
+    by storing pos + SITE_QUEUE_LEN. Producers only contend on head, the consumer never writes it.
+*/
+
+/* Initializes a freshly created segment, magic is written last so attaching processes never see it half done */
+static void site_init(struct site_shm* shm){
+    uint64_t i;
+
+    memset(shm, 0, sizeof(*shm));
+    shm->len = SITE_QUEUE_LEN;
+    for(i = 0; i < SITE_QUEUE_LEN; i++)
+        atomic_store_explicit(&shm->slots[i].seq, i, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    __atomic_store_n(&shm->magic, SITE_MAGIC, __ATOMIC_RELEASE);
+}
+
+/*
+    Maps the site segment. The aggregator passes create=1 and reuses a segment left by a previous run, so
+    occupancy survives its restart. Ramps pass create=0 and get -1 if no aggregator has created it yet.
+*/
+int site_open(struct site* s, const char* name, int create){
+    struct site_shm* shm;
+    struct stat st;
+    int created = 0;
+    int fd;
+
+    s->shm = NULL;
+    s->created = 0;
+    fd = shm_open(name, O_RDWR, 0);
+    if(fd < 0 && errno == ENOENT && create){
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+        created = fd >= 0;
+        if(created && ftruncate(fd, sizeof(*shm)) < 0){
+            close(fd);
+            shm_unlink(name);
+            return -1;
+        }
+    }
+    if(fd < 0)
+        return -1;
+    /* A segment just created by the aggregator may not have its size yet */
+    if(!created && (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*shm))){
+        close(fd);
+        return -1;
+    }
+
+    shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(shm == MAP_FAILED)
+        return -1;
+    if(created)
+        site_init(shm);
+    else if(__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != SITE_MAGIC || shm->len != SITE_QUEUE_LEN){
+        munmap(shm, sizeof(*shm));
+        return -1;
+    }
+    s->shm = shm;
+    s->created = created;
+    return 0;
+}
+
+void site_close(struct site* s){
+    if(s->shm != NULL)
+        munmap(s->shm, sizeof(*s->shm));
+    s->shm = NULL;
+}
+
+/* Queues one event without blocking, returns -1 if the site is not available or the queue is full */
+int site_post(struct site* s, const struct site_event* ev){
+    struct site_shm* shm = s->shm;
+    struct site_slot* slot;
+    uint64_t pos, seq;
+    int64_t dif;
+
+    if(shm == NULL)
+        return -1;
+    pos = atomic_load_explicit(&shm->head, memory_order_relaxed);
+    while(1){
+        slot = &shm->slots[pos & (SITE_QUEUE_LEN - 1)];
+        seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        dif = (int64_t)(seq - pos);
+        if(dif == 0){
+            if(atomic_compare_exchange_weak_explicit(&shm->head, &pos, pos + 1,
+                                                     memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if(dif < 0){
+            atomic_fetch_add_explicit(&shm->dropped, 1, memory_order_relaxed);
+            return -1;
+        }
+        else{
+            pos = atomic_load_explicit(&shm->head, memory_order_relaxed);
+        }
+    }
+    slot->ev = *ev;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+/* Takes the oldest event, only one consumer may call this. Returns 0 if the queue is empty */
+int site_take(struct site* s, struct site_event* ev){
+    struct site_shm* shm = s->shm;
+    uint64_t pos = atomic_load_explicit(&shm->tail, memory_order_relaxed);
+    struct site_slot* slot = &shm->slots[pos & (SITE_QUEUE_LEN - 1)];
+
+    if(atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1)
+        return 0;
+    *ev = slot->ev;
+    atomic_store_explicit(&slot->seq, pos + SITE_QUEUE_LEN, memory_order_release);
+    atomic_store_explicit(&shm->tail, pos + 1, memory_order_relaxed);
+    return 1;
+}
+
+/* Returns 1 while the aggregator reports the lot full, 0 when it has not been alive for SITE_STALE_MS */
+int site_full(struct site* s, uint64_t now_us){
+    if(s->shm == NULL || !atomic_load_explicit(&s->shm->full, memory_order_relaxed))
+        return 0;
+    return now_us - atomic_load_explicit(&s->shm->alive_us, memory_order_relaxed) < SITE_STALE_MS * 1000ULL;
+}
@@ -0,0 +1,63 @@
+#ifndef SITE_H
+#define SITE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+    Site occupancy shared by all ramps of a parking lot. Ramps post passage events into a bounded
+    lock-free MPSC queue in POSIX shared memory, tools/ramp_site.c consumes them and publishes lot
+    occupancy back into the same segment. Posting never blocks or waits for the aggregator: when the
+    queue is full the event is dropped and counted. Entry ramps read the full flag without syscalls and
+    ignore it once the aggregator stopped refreshing alive_us, so a dead aggregator cannot close the lot.
+*/
+#define SITE_SHM "/ramp_site"       /* Default name of the shared memory segment */
+#define SITE_QUEUE_LEN 4096         /* Queued events, power of two */
+#define SITE_LANES 64               /* Lanes with per-lane counters */
+#define SITE_STALE_MS 1000          /* A full flag older than this is not trusted */
+
+enum site_dir {
+    SITE_ENTRY = 0,                 /* Vehicle passing the ramp enters the lot */
+    SITE_EXIT                       /* Vehicle passing the ramp leaves the lot */
+};
+
+struct site_event {
+    uint64_t t_us;                  /* CLOCK_MONOTONIC time the vehicle left the ramp */
+    uint32_t dwell_ms;              /* Time spent under the boom */
+    uint16_t lane;
+    uint8_t dir;                    /* enum site_dir */
+    uint8_t reserved;
+};
+
+/* One queue cell, seq tells producers and the consumer whose turn it is */
+struct site_slot {
+    _Atomic uint64_t seq;
+    struct site_event ev;
+};
+
+struct site_shm {
+    uint32_t magic;                 /* Set last, once the segment is initialized */
+    uint32_t len;
+    _Alignas(64) _Atomic uint64_t head;   /* Next position claimed by a producer */
+    _Alignas(64) _Atomic uint64_t tail;   /* Next position taken by the consumer */
+    _Alignas(64) _Atomic uint64_t dropped;
+    _Atomic int32_t occupancy;      /* Written by the aggregator */
+    _Atomic int32_t capacity;
+    _Atomic int32_t full;
+    _Atomic uint64_t alive_us;      /* Last pass of the aggregator, CLOCK_MONOTONIC */
+    _Atomic uint64_t lane_vehicles[SITE_LANES];
+    struct site_slot slots[SITE_QUEUE_LEN];
+};
+
+struct site {
+    struct site_shm* shm;           /* NULL when the site is not available */
+    int created;                    /* Segment was created, not reused */
+};
+
+int site_open(struct site* s, const char* name, int create);
+void site_close(struct site* s);
+int site_post(struct site* s, const struct site_event* ev);
+int site_take(struct site* s, struct site_event* ev);
+int site_full(struct site* s, uint64_t now_us);
+
+#endif
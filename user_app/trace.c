@@ -0,0 +1,421 @@
+#include <string.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+/* Device and driver message of each event, as replay prints the actuator command sequence */
+static const char* event_name[TRACE_EV_COUNT] = {
+    "adc", "led OFF", "led RED", "led YELLOW", "led GREEN", "pwm b", "pwm e", "buzz b"
+};
+
+static uint64_t zigzag(int64_t v){
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v){
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static size_t put_varint(unsigned char* p, uint64_t v){
+    size_t n = 0;
+
+    while(v >= 0x80){
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+/* Decodes a varint of the block being read, returns -1 if it runs past the block */
+static int get_varint(struct trace* tr, uint64_t* v){
+    unsigned shift = 0;
+    unsigned char b;
+
+    *v = 0;
+    do{
+        if(tr->pos >= tr->block.len || shift > 63)
+            return -1;
+        b = tr->buf[tr->pos++];
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        shift += 7;
+    }while(b & 0x80);
+    return 0;
+}
+
+/* Creates a new capture file, returns 0 on success */
+int trace_create(struct trace* tr, const char* path, uint64_t start_us, enum trace_format format){
+    int64_t wall;
+
+    memset(tr, 0, sizeof(*tr));
+    tr->f = fopen(path, "wb");
+    if(tr->f == NULL)
+        return -1;
+    pthread_mutex_init(&tr->lock, NULL);
+    tr->format = format;
+    tr->writing = 1;
+    tr->wall_start = time(NULL);
+    tr->start_us = start_us;
+    wall = tr->wall_start;
+    if(fwrite(format == TRACE_COMPACT ? TRACE_MAGIC_COMPACT : TRACE_MAGIC, 1, TRACE_MAGIC_LEN, tr->f) != TRACE_MAGIC_LEN ||
+       fwrite(&wall, sizeof(wall), 1, tr->f) != 1 ||
+       fwrite(&tr->start_us, sizeof(tr->start_us), 1, tr->f) != 1){
+        trace_close(tr);
+        return -1;
+    }
+    tr->bytes = TRACE_HEADER_LEN;
+    return 0;
+}
+
+/* Writes one block with its header and flushes it */
+static int block_out(FILE* f, const struct trace_block* block, const unsigned char* buf){
+    if(fwrite(block, sizeof(*block), 1, f) != 1 || fwrite(buf, 1, block->len, f) != block->len || fflush(f) != 0)
+        return -1;
+    return 0;
+}
+
+/*
+    Finishes the block being filled and starts a new one, must be called with lock held. The block is written
+    at once, or queued for trace_drain by a deferred writer; with the queue full it is dropped.
+*/
+static int block_write(struct trace* tr){
+    struct trace_queued* q;
+    int r = 0;
+
+    if(tr->block.records == 0)
+        return 0;
+    tr->block.magic = TRACE_BLOCK_MAGIC;
+    tr->block.len = tr->pos;
+    if(!tr->deferred){
+        r = block_out(tr->f, &tr->block, tr->buf);
+    }
+    else if(tr->q_count < TRACE_QUEUE_BLOCKS){
+        q = &tr->queue[(tr->q_head + tr->q_count++) % TRACE_QUEUE_BLOCKS];
+        q->block = tr->block;
+        memcpy(q->buf, tr->buf, tr->pos);
+    }
+    else{
+        tr->dropped++;
+        r = -1;
+    }
+    if(r == 0){
+        tr->bytes += sizeof(tr->block) + tr->pos;
+        tr->blocks++;
+    }
+    tr->block.records = 0;
+    tr->pos = 0;
+    return r;
+}
+
+/* Codes one record into the current block, the block is written first if the record may not fit */
+static int compact_write(struct trace* tr, const struct trace_record* rec){
+    struct trace_coder* c = &tr->coder;
+    unsigned char* p;
+    int64_t dt;
+    int raw;
+    int r = 0;
+
+    if(tr->block.records > 0 &&
+       (tr->pos + TRACE_RECORD_MAX > TRACE_BLOCK_LEN || rec->t_us - tr->block.first_us >= TRACE_BLOCK_US))
+        r = block_write(tr);
+    if(tr->block.records == 0){
+        tr->block.first_us = rec->t_us;
+        tr->block.period_us = c->period_us;
+        c->t_us = rec->t_us;
+        c->raw = 0;
+    }
+
+    p = tr->buf + tr->pos;
+    if(rec->event == TRACE_EV_NONE){
+        dt = (int64_t)(rec->t_us - c->t_us);
+        raw = (rec->data[0] << 8) | rec->data[1];
+        tr->pos += put_varint(p, zigzag(dt - c->period_us) << 1);
+        tr->pos += put_varint(tr->buf + tr->pos, zigzag(raw - c->raw));
+        c->t_us = rec->t_us;
+        c->period_us += (dt - c->period_us) / TRACE_PERIOD_WEIGHT;
+        c->raw = raw;
+        tr->records++;
+    }
+    else{
+        tr->pos += put_varint(p, zigzag((int64_t)(rec->t_us - c->t_us)) << 1 | 1);
+        tr->buf[tr->pos++] = rec->event;
+        tr->events++;
+    }
+    tr->block.records++;
+    return r;
+}
+
+/*
+    Appends one record, safe to call from several threads. Raw files are flushed every TRACE_FLUSH_RECORDS
+    samples and cannot hold actuator commands, those are dropped. Compact files are written block by block.
+    Records arriving after trace_close are dropped too.
+*/
+int trace_write(struct trace* tr, const struct trace_record* rec){
+    int r = 0;
+
+    pthread_mutex_lock(&tr->lock);
+    if(tr->f == NULL){
+        r = -1;
+    }
+    else if(tr->format == TRACE_COMPACT){
+        r = compact_write(tr, rec);
+    }
+    else if(rec->event == TRACE_EV_NONE){
+        if(fwrite(&rec->t_us, sizeof(rec->t_us), 1, tr->f) != 1 ||
+           fwrite(rec->data, sizeof(rec->data), 1, tr->f) != 1)
+            r = -1;
+        else{
+            tr->bytes += sizeof(rec->t_us) + sizeof(rec->data);
+            if(++tr->records % TRACE_FLUSH_RECORDS == 0 && !tr->deferred)
+                fflush(tr->f);
+        }
+    }
+    pthread_mutex_unlock(&tr->lock);
+    return r;
+}
+
+/*
+    Makes trace_write only code records into memory, finished compact blocks wait for trace_drain, raw files
+    are flushed only there. For a capture written from time critical threads, the file is written by the
+    thread calling trace_drain.
+*/
+void trace_defer(struct trace* tr){
+    pthread_mutex_lock(&tr->lock);
+    tr->deferred = 1;
+    pthread_mutex_unlock(&tr->lock);
+}
+
+/*
+    Writes the blocks queued by a deferred writer, outside the lock so trace_write never waits for the file.
+    Only one thread may drain, and trace_close must be called from the same thread. Returns -1 on a write error.
+*/
+int trace_drain(struct trace* tr){
+    struct trace_queued q;
+    int r = 0;
+
+    if(tr->format == TRACE_RAW)
+        return tr->f != NULL && fflush(tr->f) != 0 ? -1 : 0;
+    for(;;){
+        pthread_mutex_lock(&tr->lock);
+        if(tr->f == NULL || tr->q_count == 0){
+            pthread_mutex_unlock(&tr->lock);
+            return r;
+        }
+        q = tr->queue[tr->q_head];
+        tr->q_head = (tr->q_head + 1) % TRACE_QUEUE_BLOCKS;
+        tr->q_count--;
+        pthread_mutex_unlock(&tr->lock);
+        if(block_out(tr->f, &q.block, q.buf) < 0)
+            r = -1;
+    }
+}
+
+/* Writes out everything recorded so far, also a block that is not full yet */
+int trace_flush(struct trace* tr){
+    int r;
+
+    pthread_mutex_lock(&tr->lock);
+    if(tr->f == NULL)
+        r = -1;
+    else
+        r = tr->format == TRACE_COMPACT ? block_write(tr) : fflush(tr->f);
+    pthread_mutex_unlock(&tr->lock);
+    if(r == 0 && tr->deferred)
+        r = trace_drain(tr);
+    return r;
+}
+
+/* Opens an existing trace of either format for replay, returns 0 on success */
+int trace_open(struct trace* tr, const char* path){
+    char magic[TRACE_MAGIC_LEN];
+    int64_t wall;
+
+    memset(tr, 0, sizeof(*tr));
+    tr->f = fopen(path, "rb");
+    if(tr->f == NULL)
+        return -1;
+    pthread_mutex_init(&tr->lock, NULL);
+    if(fread(magic, 1, TRACE_MAGIC_LEN, tr->f) != TRACE_MAGIC_LEN ||
+       fread(&wall, sizeof(wall), 1, tr->f) != 1 ||
+       fread(&tr->start_us, sizeof(tr->start_us), 1, tr->f) != 1){
+        trace_close(tr);
+        return -1;
+    }
+    if(memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0)
+        tr->format = TRACE_RAW;
+    else if(memcmp(magic, TRACE_MAGIC_COMPACT, TRACE_MAGIC_LEN) == 0)
+        tr->format = TRACE_COMPACT;
+    else{
+        trace_close(tr);
+        return -1;
+    }
+    tr->wall_start = (time_t)wall;
+    tr->bytes = TRACE_HEADER_LEN;
+    return 0;
+}
+
+/* Loads the next block of a compact trace, returns 0 at the end of the trace or at a damaged block */
+static int block_read(struct trace* tr){
+    if(fread(&tr->block, sizeof(tr->block), 1, tr->f) != 1 ||
+       tr->block.magic != TRACE_BLOCK_MAGIC || tr->block.len > TRACE_BLOCK_LEN ||
+       fread(tr->buf, 1, tr->block.len, tr->f) != tr->block.len)
+        return 0;
+    tr->bytes += sizeof(tr->block) + tr->block.len;
+    tr->blocks++;
+    tr->pos = 0;
+    tr->left = tr->block.records;
+    tr->coder.t_us = tr->block.first_us;
+    tr->coder.period_us = tr->block.period_us;
+    tr->coder.raw = 0;
+    return 1;
+}
+
+/* Decodes the next record of the current block, returns 1 on success */
+static int compact_decode(struct trace* tr, struct trace_record* rec){
+    struct trace_coder* c = &tr->coder;
+    uint64_t h, v;
+    int64_t dt;
+
+    if(tr->left == 0 || get_varint(tr, &h) < 0)
+        return 0;
+    if(h & 1){
+        if(tr->pos >= tr->block.len)
+            return 0;
+        rec->t_us = c->t_us + unzigzag(h >> 1);
+        rec->event = tr->buf[tr->pos++];
+        rec->data[0] = rec->data[1] = 0;
+    }
+    else{
+        if(get_varint(tr, &v) < 0)
+            return 0;
+        dt = c->period_us + unzigzag(h >> 1);
+        c->t_us += dt;
+        c->period_us += (dt - c->period_us) / TRACE_PERIOD_WEIGHT;
+        c->raw += unzigzag(v);
+        rec->t_us = c->t_us;
+        rec->data[0] = (unsigned char)(c->raw >> 8);
+        rec->data[1] = (unsigned char)c->raw;
+        rec->event = TRACE_EV_NONE;
+    }
+    tr->left--;
+    return 1;
+}
+
+/* Reads next sample or actuator command, returns 1 on success and 0 at the end of the trace */
+int trace_next(struct trace* tr, struct trace_record* rec){
+    if(tr->format == TRACE_RAW){
+        if(fread(&rec->t_us, sizeof(rec->t_us), 1, tr->f) != 1 ||
+           fread(rec->data, sizeof(rec->data), 1, tr->f) != 1)
+            return 0;
+        rec->event = TRACE_EV_NONE;
+        tr->bytes += sizeof(rec->t_us) + sizeof(rec->data);
+        tr->records++;
+        return 1;
+    }
+    while(tr->left == 0)
+        if(!block_read(tr))
+            return 0;
+    if(!compact_decode(tr, rec))
+        return 0;
+    if(rec->event == TRACE_EV_NONE)
+        tr->records++;
+    else
+        tr->events++;
+    return 1;
+}
+
+/* Reads next sample, skipping actuator commands, returns 1 on success and 0 at the end of the trace */
+int trace_read(struct trace* tr, struct trace_record* rec){
+    while(trace_next(tr, rec))
+        if(rec->event == TRACE_EV_NONE)
+            return 1;
+    return 0;
+}
+
+/* Reads the time of raw record i */
+static int raw_time(struct trace* tr, long i, uint64_t* t_us){
+    return fseek(tr->f, TRACE_HEADER_LEN + i * 10L, SEEK_SET) == 0 && fread(t_us, sizeof(*t_us), 1, tr->f) == 1 ? 0 : -1;
+}
+
+/*
+    Positions the trace so the next record read is the first one at or after t_us. Raw traces are bisected,
+    compact traces walk the chain of block headers without decoding them and decode only the block found.
+*/
+int trace_seek(struct trace* tr, uint64_t t_us){
+    struct trace_block h;
+    struct trace_coder c;
+    struct trace_record rec;
+    struct stat st;
+    long lo, hi, mid, found = TRACE_HEADER_LEN, off;
+    uint64_t t;
+    size_t pos;
+
+    if(tr->format == TRACE_RAW){
+        if(fstat(fileno(tr->f), &st) < 0)
+            return -1;
+        lo = 0;
+        hi = (st.st_size - TRACE_HEADER_LEN) / 10;
+        while(lo < hi){
+            mid = lo + (hi - lo) / 2;
+            if(raw_time(tr, mid, &t) < 0)
+                return -1;
+            if(t < t_us)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return fseek(tr->f, TRACE_HEADER_LEN + lo * 10L, SEEK_SET);
+    }
+
+    if(fseek(tr->f, TRACE_HEADER_LEN, SEEK_SET) != 0)
+        return -1;
+    while((off = ftell(tr->f)) >= 0 && fread(&h, sizeof(h), 1, tr->f) == 1 &&
+          h.magic == TRACE_BLOCK_MAGIC && h.len <= TRACE_BLOCK_LEN){
+        if(h.first_us > t_us && off > TRACE_HEADER_LEN)
+            break;
+        found = off;
+        if(fseek(tr->f, h.len, SEEK_CUR) != 0)
+            break;
+    }
+    if(fseek(tr->f, found, SEEK_SET) != 0)
+        return -1;
+    tr->left = 0;
+    if(!block_read(tr))
+        return 0;
+    for(;;){
+        pos = tr->pos;
+        c = tr->coder;
+        if(!compact_decode(tr, &rec))
+            return 0;
+        if(rec.t_us >= t_us){
+            tr->pos = pos;
+            tr->coder = c;
+            tr->left++;
+            return 0;
+        }
+    }
+}
+
+/*
+    Writes out queued blocks and the block being filled and closes the file, writers in other threads may
+    still be running. Called by the thread that drains a deferred writer.
+*/
+void trace_close(struct trace* tr){
+    pthread_mutex_lock(&tr->lock);
+    if(tr->f != NULL){
+        for(; tr->q_count > 0; tr->q_count--){
+            block_out(tr->f, &tr->queue[tr->q_head].block, tr->queue[tr->q_head].buf);
+            tr->q_head = (tr->q_head + 1) % TRACE_QUEUE_BLOCKS;
+        }
+        tr->deferred = 0;
+        if(tr->writing && tr->format == TRACE_COMPACT)
+            block_write(tr);
+        fclose(tr->f);
+        tr->f = NULL;
+    }
+    pthread_mutex_unlock(&tr->lock);
+}
+
+/* Returns "<device> <message>" of a TRACE_EV_* code */
+const char* trace_event_name(int ev){
+    return ev >= 0 && ev < TRACE_EV_COUNT ? event_name[ev] : "?";
+}
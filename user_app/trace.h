@@ -0,0 +1,118 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+/*
+    Sensor trace files in two formats, both read by trace_open / trace_read. Integers are in host byte order.
+    Both start with a header: magic | int64 wall clock seconds at start | uint64 monotonic us at start.
+
+    Raw ("RAMPTRC1"): fixed size records of uint64 monotonic us | 2 raw bytes as returned by adc_driver.
+
+    Compact ("RAMPTRZ1"): ADC samples and actuator commands in blocks of at most TRACE_BLOCK_LEN bytes, each
+    a struct trace_block header followed by its records. Every block restarts the delta coding, so it decodes
+    on its own. The block headers chain through the file and serve as the index for seeking, and a capture
+    cut short loses only the block being filled. A deferred writer (trace_defer) never writes from trace_write,
+    finished blocks wait in a queue until the thread owning the file calls trace_drain. Records are varints:
+      sample: zigzag(dt - period) << 1 | 0, zigzag(raw - previous raw)
+              dt is the time since the previous sample and period a running average of dt, so sensor
+              wakeup jitter is coded once and not twice as a difference of intervals would. Time, period
+              and raw start from first_us, period_us and 0 of the block.
+      event:  zigzag(t - previous sample time) << 1 | 1, TRACE_EV_* code
+    A steady sampling rate and a quiet lane code to 2 bytes per sample instead of 10.
+*/
+#define TRACE_MAGIC "RAMPTRC1"
+#define TRACE_MAGIC_COMPACT "RAMPTRZ1"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_HEADER_LEN (TRACE_MAGIC_LEN + 16)
+#define TRACE_FLUSH_RECORDS 256 /* Records buffered before a raw capture file is flushed */
+#define TRACE_BLOCK_MAGIC 0x4B4C4254u /* "TBLK" */
+#define TRACE_BLOCK_LEN 4096    /* Largest block payload, one flash page sized write per block */
+#define TRACE_BLOCK_US 2000000  /* A block is written once it spans this long, even if not full */
+#define TRACE_RECORD_MAX 20     /* Longest coded record */
+#define TRACE_PERIOD_WEIGHT 8   /* Sampling interval average moves by 1/8 of each deviation */
+#define TRACE_QUEUE_BLOCKS 4    /* Finished blocks a deferred writer keeps until trace_drain */
+
+enum trace_format { TRACE_RAW = 0, TRACE_COMPACT };
+
+/* Actuator commands recorded in compact traces */
+enum trace_event {
+    TRACE_EV_NONE = 0,          /* ADC sample */
+    TRACE_EV_LIGHTS_OFF,
+    TRACE_EV_RED,
+    TRACE_EV_YELLOW,
+    TRACE_EV_GREEN,
+    TRACE_EV_BOOM_UP,
+    TRACE_EV_BOOM_DOWN,
+    TRACE_EV_BUZZ,
+    TRACE_EV_COUNT
+};
+
+struct trace_record {
+    uint64_t t_us;
+    unsigned char data[2];      /* Raw sample, samples only */
+    uint8_t event;              /* TRACE_EV_NONE for a sample */
+};
+
+struct trace_block {
+    uint32_t magic;             /* TRACE_BLOCK_MAGIC */
+    uint32_t len;               /* Payload bytes following the header */
+    uint32_t records;
+    int32_t period_us;          /* Sampling interval estimate the block starts with */
+    uint64_t first_us;          /* Time of the first record, the delta coding starts from it */
+};
+
+/* Finished block waiting for trace_drain */
+struct trace_queued {
+    struct trace_block block;
+    unsigned char buf[TRACE_BLOCK_LEN];
+};
+
+/* Delta coding state, reset at every block */
+struct trace_coder {
+    uint64_t t_us;              /* Previous sample time */
+    int64_t period_us;          /* Running average of the sampling interval, the prediction of the next one */
+    int raw;                    /* Previous sample value */
+};
+
+struct trace {
+    FILE* f;
+    enum trace_format format;
+    time_t wall_start;
+    uint64_t start_us;
+    unsigned long records;      /* Samples written or read */
+    unsigned long events;       /* Actuator commands written or read */
+    int writing;
+    /* Compact format: block being filled or decoded */
+    pthread_mutex_t lock;       /* Writers from several threads, samples and actuator commands */
+    struct trace_block block;
+    struct trace_coder coder;
+    unsigned char buf[TRACE_BLOCK_LEN];
+    size_t pos;                 /* Write or read position in buf */
+    uint32_t left;              /* Records of the block not read yet */
+    unsigned long blocks;
+    uint64_t bytes;             /* File size written or read so far */
+    /* Deferred compact writer: finished blocks queued for trace_drain */
+    int deferred;
+    struct trace_queued queue[TRACE_QUEUE_BLOCKS];
+    int q_head;
+    int q_count;
+    unsigned long dropped;      /* Blocks lost because the queue was full */
+};
+
+int trace_create(struct trace* tr, const char* path, uint64_t start_us, enum trace_format format);
+int trace_write(struct trace* tr, const struct trace_record* rec);
+int trace_flush(struct trace* tr);
+void trace_defer(struct trace* tr);
+int trace_drain(struct trace* tr);
+int trace_open(struct trace* tr, const char* path);
+int trace_read(struct trace* tr, struct trace_record* rec);
+int trace_next(struct trace* tr, struct trace_record* rec);
+int trace_seek(struct trace* tr, uint64_t t_us);
+void trace_close(struct trace* tr);
+const char* trace_event_name(int ev);
+
+#endif
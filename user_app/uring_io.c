@@ -0,0 +1,282 @@
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include "uring_io.h"
+
+#define TIMEOUT_SLOT 0xFFFFFFFFu /* Slot in user_data of link timeouts, their completions carry no result */
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p){
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags){
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_enter_timeout(int fd, unsigned to_submit, unsigned min_complete, uint64_t timeout_us){
+    struct __kernel_timespec ts = { timeout_us / 1000000, (timeout_us % 1000000) * 1000 };
+    struct io_uring_getevents_arg arg;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+static uint64_t mono_us(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args){
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* Sets up the ring and registers given files (index in fds is the file index for requests) and buffers */
+int uring_io_init(struct uring_io* u, const int* fds, int nfds){
+    struct io_uring_params p;
+    struct iovec iov;
+    char* sq;
+    char* cq;
+
+    memset(u, 0, sizeof(*u));
+    memset(&p, 0, sizeof(p));
+    u->fd = sys_io_uring_setup(URING_ENTRIES, &p);
+    if(u->fd < 0)
+        return -1;
+    u->features = p.features;
+
+    u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        if(u->cq_len > u->sq_len)
+            u->sq_len = u->cq_len;
+        u->cq_len = u->sq_len;
+    }
+    u->sq_ptr = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if(u->sq_ptr == MAP_FAILED)
+        goto fail;
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        u->cq_ptr = u->sq_ptr;
+    }
+    else{
+        u->cq_ptr = mmap(NULL, u->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if(u->cq_ptr == MAP_FAILED)
+            goto fail;
+    }
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if(u->sqes == MAP_FAILED)
+        goto fail;
+
+    sq = u->sq_ptr;
+    cq = u->cq_ptr;
+    u->sq_head = (unsigned*)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*)(sq + p.sq_off.array);
+    u->cq_head = (unsigned*)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    u->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    if(sys_io_uring_register(u->fd, IORING_REGISTER_FILES, fds, nfds) < 0)
+        goto fail;
+    iov.iov_base = u->bufs;
+    iov.iov_len = sizeof(u->bufs);
+    if(sys_io_uring_register(u->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+        goto fail;
+    return 0;
+
+fail:
+    uring_io_exit(u);
+    return -1;
+}
+
+/* Takes the next SQE of the batch */
+static struct io_uring_sqe* next_sqe(struct uring_io* u){
+    unsigned tail = *u->sq_tail + u->queued;
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe* sqe = &u->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    u->queued++;
+    return sqe;
+}
+
+/* Queues a write of data to registered file, returns request index in the batch or -1 */
+int uring_io_write(struct uring_io* u, int file_idx, const void* data, size_t len){
+    struct io_uring_sqe* sqe;
+    int slot;
+
+    if(len > URING_BUF_LEN)
+        len = URING_BUF_LEN;
+    if(u->queued >= URING_ENTRIES && uring_io_submit(u) < 0)
+        return -1;
+
+    slot = u->expected;
+    memcpy(u->bufs[slot], data, len);
+    sqe = next_sqe(u);
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = file_idx;
+    sqe->addr = (uint64_t)(uintptr_t)u->bufs[slot];
+    sqe->len = len;
+    sqe->buf_index = 0;
+    sqe->user_data = (uint64_t)u->batch << 32 | slot;
+    u->results[slot] = -ECANCELED;
+    u->files[slot] = file_idx;
+    u->lens[slot] = len;
+    u->expected++;
+    return slot;
+}
+
+/*
+    Queues a read of len bytes from registered file, bounded by a linked timeout if timeout_us is non zero.
+    Returns request index in the batch, data is in bufs[index] after submit, or -1.
+*/
+int uring_io_read(struct uring_io* u, int file_idx, size_t len, uint64_t timeout_us){
+    struct io_uring_sqe* sqe;
+    int slot;
+
+    if(len > URING_BUF_LEN)
+        len = URING_BUF_LEN;
+    if(u->queued + 2 > URING_ENTRIES && uring_io_submit(u) < 0)
+        return -1;
+
+    slot = u->expected;
+    sqe = next_sqe(u);
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = file_idx;
+    sqe->addr = (uint64_t)(uintptr_t)u->bufs[slot];
+    sqe->len = len;
+    sqe->buf_index = 0;
+    sqe->user_data = (uint64_t)u->batch << 32 | slot;
+    u->results[slot] = -ECANCELED;
+    u->files[slot] = file_idx;
+    u->lens[slot] = len;
+    u->expected++;
+
+    if(timeout_us > 0){
+        if(timeout_us > u->timeout_us)
+            u->timeout_us = timeout_us;
+        sqe->flags |= IOSQE_IO_LINK;
+        u->timeouts[slot].tv_sec = timeout_us / 1000000;
+        u->timeouts[slot].tv_nsec = (timeout_us % 1000000) * 1000;
+        sqe = next_sqe(u);
+        sqe->opcode = IORING_OP_LINK_TIMEOUT;
+        sqe->addr = (uint64_t)(uintptr_t)&u->timeouts[slot];
+        sqe->len = 1;
+        sqe->user_data = (uint64_t)u->batch << 32 | TIMEOUT_SLOT;
+    }
+    return slot;
+}
+
+/* Takes the completions that are ready, returns how many of them belong to the current batch */
+static unsigned reap(struct uring_io* u){
+    struct io_uring_cqe* cqe;
+    unsigned head, seen = 0;
+    uint32_t slot;
+
+    for(head = *u->cq_head; head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE); head++){
+        cqe = &u->cqes[head & *u->cq_mask];
+        /* Completions of an earlier batch that was given up on are dropped */
+        if((uint32_t)(cqe->user_data >> 32) == u->batch){
+            slot = (uint32_t)cqe->user_data;
+            if(slot != TIMEOUT_SLOT)
+                u->results[slot] = cqe->res;
+            seen++;
+        }
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    return seen;
+}
+
+/*
+    Submits the batch and waits for its completions, normally with a single io_uring_enter. Requests the
+    kernel did not take are offered once more and then withdrawn, and the wait ends after URING_WAIT_US
+    plus the longest linked timeout. Results are stored in results[], returns the number of requests
+    without a full length result or -1 on ring error, in which case results[] of the batch stay -ECANCELED.
+*/
+int uring_io_submit(struct uring_io* u){
+    int ext = (u->features & IORING_FEAT_EXT_ARG) != 0;
+    uint64_t wait_us = URING_WAIT_US + u->timeout_us;
+    uint64_t deadline, now;
+    struct pollfd pfd;
+    unsigned taken, seen, slot;
+    int failed = 0;
+    int ret;
+
+    if(u->queued == 0)
+        return 0;
+
+    u->submitted = u->expected;
+    __atomic_store_n(u->sq_tail, *u->sq_tail + u->queued, __ATOMIC_RELEASE);
+    deadline = mono_us() + wait_us;
+
+    do{
+        ret = ext ? sys_io_uring_enter_timeout(u->fd, u->queued, u->queued, wait_us) :
+                    sys_io_uring_enter(u->fd, u->queued, 0, 0);
+    }while(ret < 0 && errno == EINTR);
+    u->enters++;
+    taken = ret > 0 ? ret : 0;
+    if(taken < u->queued && ret >= 0){
+        ret = sys_io_uring_enter(u->fd, u->queued - taken, 0, 0);
+        u->enters++;
+        if(ret > 0)
+            taken += ret;
+    }
+    /* Entries still in the submission queue would go out with the next batch, take them back */
+    if(taken < u->queued)
+        __atomic_store_n(u->sq_tail, __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+
+    seen = reap(u);
+    while(seen < taken && (now = mono_us()) < deadline){
+        /* Rest of the batch is still in flight (e.g. buzzer write punted to a worker) */
+        if(ext){
+            ret = sys_io_uring_enter_timeout(u->fd, 0, taken - seen, deadline - now);
+        }
+        else{
+            pfd.fd = u->fd;
+            pfd.events = POLLIN;
+            ret = poll(&pfd, 1, (deadline - now + 999) / 1000);
+        }
+        u->enters++;
+        seen += reap(u);
+        if(ret < 0 && errno != EINTR && errno != ETIME)
+            break;
+    }
+
+    if(taken == 0)
+        failed = -1;
+    else
+        for(slot = 0; slot < u->expected; slot++)
+            if(u->results[slot] != (int)u->lens[slot])
+                failed++;
+    u->queued = 0;
+    u->expected = 0;
+    u->timeout_us = 0;
+    u->batch++;
+    return failed;
+}
+
+void uring_io_exit(struct uring_io* u){
+    if(u->sqes != NULL && u->sqes != MAP_FAILED)
+        munmap(u->sqes, u->sqes_len);
+    if(u->cq_ptr != NULL && u->cq_ptr != MAP_FAILED && u->cq_ptr != u->sq_ptr)
+        munmap(u->cq_ptr, u->cq_len);
+    if(u->sq_ptr != NULL && u->sq_ptr != MAP_FAILED)
+        munmap(u->sq_ptr, u->sq_len);
+    if(u->fd >= 0)
+        close(u->fd);
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+}
@@ -0,0 +1,61 @@
+#ifndef URING_IO_H
+#define URING_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+/*
+    Minimal io_uring wrapper on top of the raw syscalls. Requests are queued into a batch and the whole
+    batch is normally submitted and reaped with one io_uring_enter. Requests of a batch are independent, a failed
+    one does not cancel the others; only a read is linked to its timeout. Driver files and the data
+    buffers are registered once, so requests use fixed files and fixed buffers. A request counts as done
+    only when its result is the full length queued. After submit, results[], files[] and lens[] of the
+    batch tell the caller which requests to repeat. Submit waits at most URING_WAIT_US plus the longest
+    linked timeout of the batch; completions arriving after that are recognized by their batch number
+    and dropped.
+    One ring must only be used by one thread at a time.
+*/
+#define URING_ENTRIES 16   /* Submission queue size, also the longest batch */
+#define URING_BUF_LEN 16   /* Registered buffer slot size, longest driver message */
+#define URING_WAIT_US 20000 /* Longest wait for completions of a batch beyond its linked timeouts */
+
+struct uring_io {
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ptr;
+    size_t sq_len;
+    void* cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+    unsigned features;                        /* IORING_FEAT_* of the ring */
+
+    char bufs[URING_ENTRIES][URING_BUF_LEN];  /* Registered buffers, slot i belongs to request i of the batch */
+    struct __kernel_timespec timeouts[URING_ENTRIES];
+    int results[URING_ENTRIES];               /* Results of the last submitted batch */
+    int files[URING_ENTRIES];                 /* Registered file index of each request */
+    unsigned lens[URING_ENTRIES];             /* Length of each request */
+    unsigned submitted;                       /* Requests with a result in the last submitted batch */
+    unsigned queued;                          /* Requests in the current batch */
+    unsigned expected;                        /* Requests with a result in the current batch */
+    uint64_t timeout_us;                      /* Longest linked timeout of the current batch */
+    uint32_t batch;                           /* Number of the current batch, upper half of user_data */
+    unsigned long enters;                     /* io_uring_enter calls, for syscall accounting */
+};
+
+int uring_io_init(struct uring_io* u, const int* fds, int nfds);
+int uring_io_write(struct uring_io* u, int file_idx, const void* data, size_t len);
+int uring_io_read(struct uring_io* u, int file_idx, size_t len, uint64_t timeout_us);
+int uring_io_submit(struct uring_io* u);
+void uring_io_exit(struct uring_io* u);
+
+#endif
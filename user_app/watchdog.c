@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "watchdog.h"
+
+void monitor_init(struct loop_monitor* m, const char* name, uint64_t budget_us, enum metric_counter counter){
+    m->name = name;
+    m->budget_us = budget_us;
+    m->counter = counter;
+    atomic_store(&m->last_beat_us, now_us());
+    atomic_store(&m->misses, 0);
+    atomic_store(&m->last_miss_wall, 0);
+}
+
+/* Records a deadline miss of late_us, counted and timestamped */
+void monitor_miss(struct loop_monitor* m, uint64_t late_us){
+    time_t t = wall_time();
+    struct tm tm;
+    char stamp[32];
+
+    atomic_fetch_add(&m->misses, 1);
+    atomic_store(&m->last_miss_wall, (int64_t)t);
+    metrics_inc(m->counter);
+
+    localtime_r(&t, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    fprintf(stderr, "%s %s loop missed deadline by %llu us\n", stamp, m->name, (unsigned long long)late_us);
+}
+
+/* Marks one finished loop iteration, iteration longer than the budget is a deadline miss */
+void monitor_beat(struct loop_monitor* m){
+    uint64_t now = now_us();
+    uint64_t last = atomic_exchange(&m->last_beat_us, now);
+
+    if(now > last && now - last > m->budget_us)
+        monitor_miss(m, now - last - m->budget_us);
+}
+
+/* Returns 1 if the loop made no progress for WATCHDOG_STALL_US */
+int monitor_stalled(struct loop_monitor* m){
+    uint64_t now = now_us();
+    uint64_t last = atomic_load(&m->last_beat_us);
+
+    return now > last && now - last > WATCHDOG_STALL_US;
+}
+
+/* Re-arms the kernel watchdogs of the LED and PWM drivers */
+void watchdog_kick(int led_fd, int pwm_fd){
+    write(led_fd, WD_KICK_LED, strlen(WD_KICK_LED) + 1);
+    write(pwm_fd, WD_KICK_PWM, strlen(WD_KICK_PWM));
+}
@@ -0,0 +1,36 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "metrics.h"
+
+/*
+    Deadline accounting for the control loops and heartbeats for the kernel watchdogs in led_driver and
+    pwm_driver. Heartbeats are only sent while every monitored loop makes progress; if they stop, the
+    drivers switch to the safe state (red light, boom up) on their own within wd_timeout_ms.
+*/
+#define WATCHDOG_PERIOD_MS 100        /* Heartbeat period of the main loop */
+#define WATCHDOG_STALL_US 300000      /* Loop without progress for this long is considered stalled */
+#define SENSOR_DEADLINE_US 150000     /* Budget of one sensor loop iteration, covers idle sampling period and adc_driver worst case */
+#define CYCLE_DEADLINE_US 20000       /* Allowed lateness of a phase change */
+
+#define WD_KICK_LED "HB"              /* Heartbeat message for led_driver */
+#define WD_KICK_PWM "h"               /* Heartbeat message for pwm_driver */
+
+struct loop_monitor {
+    const char* name;
+    uint64_t budget_us;
+    enum metric_counter counter;      /* Metrics counter for misses of this loop */
+    _Atomic uint64_t last_beat_us;    /* Last time the loop made progress */
+    _Atomic uint64_t misses;
+    _Atomic int64_t last_miss_wall;   /* Wall clock time of the last miss */
+};
+
+void monitor_init(struct loop_monitor* m, const char* name, uint64_t budget_us, enum metric_counter counter);
+void monitor_beat(struct loop_monitor* m);
+void monitor_miss(struct loop_monitor* m, uint64_t late_us);
+int monitor_stalled(struct loop_monitor* m);
+void watchdog_kick(int led_fd, int pwm_fd);
+
+#endif